@@ -0,0 +1,149 @@
+#include "../config.hpp"
+#include "../pictures.hpp"
+#include "../detection.hpp"
+#include "../profiler.hpp"
+#include "generator.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+/*
+    Compares the stroke maps of reduced ray densities to the full density
+    on a corpus, to choose rayDensity for it.
+
+    missing are stroke pixels of the full density that became background,
+    added are background pixels that became strokes, both relative to the
+    stroke pixels of the full density. width is the mean absolute stroke
+    width difference where both have strokes. A synthetic page of axis
+    aligned bars on odd rows and columns is measured on its own, reduced
+    densities must not lose whole bars there.
+*/
+
+struct Deviation {
+    double strokePixels;
+    double missing;
+    double added;
+    double widthDifference;
+    double commonPixels;
+    double seconds;
+    Deviation() : strokePixels(0), missing(0), added(0), widthDifference(0), commonPixels(0), seconds(0) {}
+};
+
+cv::Mat_<StrokeValue> castRays(const cv::Mat& original, const cv::Mat& input, const Config::Parameters& parameters, double& seconds)
+{
+    Pictures::initialize(original, input);
+    const double start = Profiler::now();
+    Detection detection(parameters);
+    detection.castRays();
+    seconds += Profiler::now() - start;
+    const cv::Mat_<StrokeValue> strokes = Pictures::strokes;
+    Pictures::release();
+    return strokes;
+}
+
+void compare(const cv::Mat_<StrokeValue>& full, const cv::Mat_<StrokeValue>& reduced, Deviation& deviation)
+{
+    for(int y = 0; y < full.rows; ++y) {
+        const StrokeValue* const fullRow = full[y];
+        const StrokeValue* const reducedRow = reduced[y];
+        for(int x = 0; x < full.cols; ++x) {
+            const bool fullStroke = fullRow[x] != Constants::strokeBackground;
+            const bool reducedStroke = reducedRow[x] != Constants::strokeBackground;
+            if(fullStroke)
+                ++deviation.strokePixels;
+            if(fullStroke && !reducedStroke)
+                ++deviation.missing;
+            else if(!fullStroke && reducedStroke)
+                ++deviation.added;
+            else if(fullStroke) {
+                deviation.widthDifference += std::abs((int) fullRow[x] - (int) reducedRow[x]);
+                ++deviation.commonPixels;
+            }
+        }
+    }
+}
+
+void compareDensities(const cv::Mat& original, const cv::Mat& input, const std::vector<float>& densities, double& fullSeconds, std::vector<Deviation>& deviations)
+{
+    Config::Parameters fullParameters = Config::parameters;
+    fullParameters.rayDensity = 1;
+    const cv::Mat_<StrokeValue> full = castRays(original, input, fullParameters, fullSeconds);
+    for(size_t i = 0; i != densities.size(); ++i) {
+        Config::Parameters parameters = Config::parameters;
+        parameters.rayDensity = densities[i];
+        parameters.validate();
+        compare(full, castRays(original, input, parameters, deviations[i].seconds), deviations[i]);
+    }
+}
+
+void printDeviations(const std::string& title, const std::vector<float>& densities, const double fullSeconds, const std::vector<Deviation>& deviations)
+{
+    std::cout<<title<<std::endl;
+    std::cout<<std::setw(10)<<"density"<<std::setw(10)<<"missing"<<std::setw(10)<<"added"<<std::setw(10)<<"width"<<std::setw(10)<<"speedup"<<std::endl;
+    for(size_t i = 0; i != densities.size(); ++i) {
+        const Deviation& deviation = deviations[i];
+        const double strokePixels = std::max(deviation.strokePixels, 1.0);
+        std::cout<<std::fixed<<std::setprecision(4)<<std::setw(10)<<densities[i]
+            <<std::setprecision(2)<<std::setw(9)<<deviation.missing / strokePixels * 100<<'%'
+            <<std::setw(9)<<deviation.added / strokePixels * 100<<'%'
+            <<std::setw(10)<<deviation.widthDifference / std::max(deviation.commonPixels, 1.0)
+            <<std::setw(9)<<(deviation.seconds > 0 ? fullSeconds / deviation.seconds : 0)<<'x'<<std::endl;
+    }
+}
+
+std::vector<float> parseList(const std::string& list)
+{
+    std::vector<float> values;
+    std::stringstream stream(list);
+    std::string value;
+    while(std::getline(stream, value, ',')) {
+        values.push_back(std::atof(value.c_str()));
+    }
+    return values;
+}
+
+/*
+    Usage: density [--densities 0.5,0.25,...] <image>...
+*/
+int main(const int argc, const char** argv)
+{
+    std::vector<float> densities = parseList("0.5,0.25,0.125,0.0625");
+    std::vector<std::string> fileNames;
+    for(int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if(argument == "--densities" && i + 1 < argc)
+            densities = parseList(argv[++i]);
+        else
+            fileNames.push_back(argument);
+    }
+    try {
+        Config::readConfigFile();
+    } catch (const char* e) {
+        std::cerr<<e<<std::endl<<"Aborting…\n";
+        return -1;
+    }
+    double fullSeconds = 0;
+    std::vector<Deviation> deviations(densities.size());
+    for(std::vector<std::string>::const_iterator fileName = fileNames.begin(); fileName != fileNames.end(); ++fileName) {
+        cv::Mat original, input;
+        try {
+            Pictures::decode(*fileName, original, input);
+        } catch (const char* e) {
+            std::cerr<<*fileName<<": "<<e<<std::endl;
+            continue;
+        }
+        compareDensities(original, input, densities, fullSeconds, deviations);
+    }
+    SyntheticBars bars;
+    const cv::Mat barsPage = bars.render();
+    cv::Mat grayBarsPage;
+    cv::cvtColor(barsPage, grayBarsPage, CV_BGR2GRAY);
+    double barsFullSeconds = 0;
+    std::vector<Deviation> barsDeviations(densities.size());
+    compareDensities(barsPage, grayBarsPage, densities, barsFullSeconds, barsDeviations);
+    printDeviations("corpus", densities, fullSeconds, deviations);
+    printDeviations(bars.describe(), densities, barsFullSeconds, barsDeviations);
+    return 0;
+}
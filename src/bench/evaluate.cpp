@@ -0,0 +1,189 @@
+#include <dirent.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <opencv/cv.h>
+
+/*
+    Scores octoshark's TEXT_OUTPUT box files against ICDAR style ground
+    truth and compares them to stored golden outputs.
+
+    Ground truth files are named gt_<image>.txt or <image>.txt and hold one
+    box per line as "x1, y1, x2, y2" optionally followed by a transcription,
+    detection files are what octoshark writes with --output <directory>.
+    Precision and recall are the ICDAR 2003 best match measures, f is their
+    harmonic mean. Missing detection or golden files fail the evaluation
+    like differing ones.
+*/
+
+std::vector<cv::Rect> readGroundTruth(const std::string& fileName)
+{
+    std::vector<cv::Rect> boxes;
+    std::ifstream stream(fileName.c_str());
+    std::string line;
+    while(std::getline(stream, line)) {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::stringstream values(line);
+        int x1, y1, x2, y2;
+        if(values>>x1>>y1>>x2>>y2)
+            boxes.push_back(cv::Rect(x1, y1, x2 - x1 + 1, y2 - y1 + 1));
+    }
+    return boxes;
+}
+
+std::vector<std::string> readDetectionLines(const std::string& fileName, bool& exists)
+{
+    std::vector<std::string> lines;
+    std::ifstream stream(fileName.c_str());
+    exists = stream.is_open();
+    std::string line;
+    while(std::getline(stream, line)) {
+        if(!line.empty() && line[0] != '#')
+            lines.push_back(line);
+    }
+    return lines;
+}
+
+std::vector<cv::Rect> parseDetections(const std::vector<std::string>& lines)
+{
+    std::vector<cv::Rect> boxes;
+    for(std::vector<std::string>::const_iterator i = lines.begin(); i != lines.end(); ++i) {
+        std::string line = *i;
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::stringstream values(line);
+        cv::Rect box;
+        if(values>>box.x>>box.y>>box.width>>box.height)
+            boxes.push_back(box);
+    }
+    return boxes;
+}
+
+double bestMatch(const cv::Rect& box, const std::vector<cv::Rect>& others)
+{
+    double best = 0;
+    for(std::vector<cv::Rect>::const_iterator i = others.begin(); i != others.end(); ++i) {
+        const double intersection = (box & *i).area();
+        const double hull = (box | *i).area();
+        if(hull > 0)
+            best = std::max(best, intersection / hull);
+    }
+    return best;
+}
+
+std::vector<std::string> listDirectory(const std::string& directory)
+{
+    std::vector<std::string> names;
+    DIR* handle = opendir(directory.c_str());
+    if(handle == NULL)
+        return names;
+    while(dirent* entry = readdir(handle)) {
+        const std::string name = entry->d_name;
+        if(name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0)
+            names.push_back(name);
+    }
+    closedir(handle);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+/*
+    Sums the stage seconds and keeps the largest peak memory of the JSON
+    lines written by octoshark --profile.
+*/
+void summarizeProfile(const std::string& fileName)
+{
+    std::ifstream stream(fileName.c_str());
+    if(!stream.is_open())
+        return;
+    std::map<std::string, double> stageSeconds;
+    double peakMemoryBytes = 0;
+    int images = 0;
+    std::string line;
+    while(std::getline(stream, line)) {
+        ++images;
+        const size_t secondsStart = line.find("\"seconds\":{");
+        if(secondsStart != std::string::npos) {
+            std::stringstream stages(line.substr(secondsStart + 11, line.find('}', secondsStart) - secondsStart - 11));
+            std::string stage;
+            while(std::getline(stages, stage, ',')) {
+                const size_t colon = stage.rfind(':');
+                if(colon != std::string::npos && stage.size() > 2)
+                    stageSeconds[stage.substr(1, colon - 2)] += std::atof(stage.c_str() + colon + 1);
+            }
+        }
+        const size_t memoryStart = line.find("\"peakMemoryBytes\":");
+        if(memoryStart != std::string::npos)
+            peakMemoryBytes = std::max(peakMemoryBytes, std::atof(line.c_str() + memoryStart + 18));
+    }
+    std::cout<<"time over "<<images<<" images:\n";
+    for(std::map<std::string, double>::const_iterator i = stageSeconds.begin(); i != stageSeconds.end(); ++i) {
+        std::cout<<"  "<<std::left<<std::setw(26)<<i->first<<std::right<<std::setw(10)<<i->second<<" s\n";
+    }
+    std::cout<<"peak memory "<<peakMemoryBytes / (1024 * 1024)<<" MiB\n";
+}
+
+int main(const int argc, const char** argv)
+{
+    std::map<std::string, std::string> options;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        options[argv[i]] = argv[i + 1];
+    }
+    if(options["--groundtruth"].empty() || options["--detections"].empty()) {
+        std::cerr<<"Usage: evaluate --groundtruth <directory> --detections <directory> [--golden <directory>] [--profile <file>]\n";
+        return -1;
+    }
+    const std::string golden = options["--golden"];
+    double precisionSum = 0, recallSum = 0;
+    int detectionCount = 0, groundTruthCount = 0, missingFiles = 0, goldenDifferences = 0;
+    const std::vector<std::string> names = listDirectory(options["--groundtruth"]);
+    for(std::vector<std::string>::const_iterator i = names.begin(); i != names.end(); ++i) {
+        const std::string imageName = i->compare(0, 3, "gt_") == 0 ? i->substr(3) : *i;
+        const std::vector<cv::Rect> truth = readGroundTruth(options["--groundtruth"] + "/" + *i);
+        bool exists;
+        const std::vector<std::string> lines = readDetectionLines(options["--detections"] + "/" + imageName, exists);
+        if(!exists) {
+            std::cerr<<"missing detections for "<<imageName<<std::endl;
+            ++missingFiles;
+        }
+        const std::vector<cv::Rect> detections = parseDetections(lines);
+        for(std::vector<cv::Rect>::const_iterator j = detections.begin(); j != detections.end(); ++j) {
+            precisionSum += bestMatch(*j, truth);
+        }
+        for(std::vector<cv::Rect>::const_iterator j = truth.begin(); j != truth.end(); ++j) {
+            recallSum += bestMatch(*j, detections);
+        }
+        detectionCount += detections.size();
+        groundTruthCount += truth.size();
+        if(!golden.empty()) {
+            bool goldenExists;
+            const std::vector<std::string> goldenLines = readDetectionLines(golden + "/" + imageName, goldenExists);
+            if(!goldenExists) {
+                std::cerr<<"missing golden output for "<<imageName<<std::endl;
+                ++missingFiles;
+            } else if(goldenLines != lines) {
+                size_t line = 0;
+                while(line < lines.size() && line < goldenLines.size() && lines[line] == goldenLines[line])
+                    ++line;
+                std::cout<<imageName<<" differs from golden output at box "<<line<<": "
+                    <<(line < lines.size() ? lines[line] : "<none>")<<" instead of "
+                    <<(line < goldenLines.size() ? goldenLines[line] : "<none>")<<std::endl;
+                ++goldenDifferences;
+            }
+        }
+    }
+    const double precision = detectionCount == 0 ? 0 : precisionSum / detectionCount;
+    const double recall = groundTruthCount == 0 ? 0 : recallSum / groundTruthCount;
+    const double f = precision + recall == 0 ? 0 : 2 * precision * recall / (precision + recall);
+    std::cout<<std::fixed<<std::setprecision(4)
+        <<names.size()<<" images, "<<detectionCount<<" detections, "<<groundTruthCount<<" ground truth boxes\n"
+        <<"precision "<<precision<<"\nrecall    "<<recall<<"\nf         "<<f<<std::endl;
+    if(options.count("--profile"))
+        summarizeProfile(options["--profile"]);
+    if(!golden.empty())
+        std::cout<<goldenDifferences<<" images differ from the golden outputs"<<std::endl;
+    return goldenDifferences == 0 && missingFiles == 0 ? 0 : 1;
+}
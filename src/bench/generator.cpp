@@ -0,0 +1,134 @@
+#include "generator.hpp"
+#include <cmath>
+#include <sstream>
+
+namespace Constants {
+    const char* const syntheticWords[] = {
+        "octoshark", "stroke", "width", "transform", "letter", "line", "Quick", "brown",
+        "FOX", "jumps", "over", "the", "lazy", "dog", "2010", "seminar", "Multimedia",
+        "analysis", "region", "text", "OCR", "edge", "parallel", "candidate"
+    };
+    const int syntheticFont = cv::FONT_HERSHEY_SIMPLEX;
+}
+
+SyntheticText::SyntheticText() :
+    megapixels(1),
+    fontScale(1),
+    strokeWidth(2),
+    rotation(0),
+    density(0.3),
+    noise(0),
+    seed(2010)
+    {}
+
+std::string SyntheticText::describe() const
+{
+    std::stringstream description;
+    description<<megapixels<<"MP font="<<fontScale<<" stroke="<<strokeWidth<<" rotation="<<rotation<<" density="<<density<<" noise="<<noise;
+    return description.str();
+}
+
+/*
+    density is the fraction of the page height covered by text lines.
+    lineBoxes receives the axis aligned bounds of every rendered line after
+    rotation, which is what octoshark reports as well.
+*/
+cv::Mat SyntheticText::render(std::vector<cv::Rect>* lineBoxes) const
+{
+    const int width = std::sqrt(megapixels * 1000000 * 4 / 3);
+    const int height = megapixels * 1000000 / width;
+    cv::Mat page(height, width, CV_8UC3, cv::Scalar(255, 255, 255));
+    cv::RNG rng(seed);
+    int baseline = 0;
+    const cv::Size glyphSize = cv::getTextSize("Hg", Constants::syntheticFont, fontScale, strokeWidth, &baseline);
+    const int lineHeight = glyphSize.height + baseline;
+    const int lineSpacing = std::max(lineHeight + 1, (int) (lineHeight / std::max(density, 0.01)));
+    const int margin = lineHeight;
+    const int wordCount = sizeof(Constants::syntheticWords)/sizeof(char*);
+    std::vector<cv::Rect> boxes;
+    for(int y = margin + glyphSize.height; y + baseline + margin < height; y += lineSpacing) {
+        const cv::Scalar color(rng.uniform(0, 80), rng.uniform(0, 80), rng.uniform(0, 80));
+        int x = margin;
+        cv::Rect box;
+        while(true) {
+            const std::string word = Constants::syntheticWords[rng.uniform(0, wordCount)];
+            const cv::Size wordSize = cv::getTextSize(word, Constants::syntheticFont, fontScale, strokeWidth, &baseline);
+            if(x + wordSize.width + margin > width)
+                break;
+            cv::putText(page, word, cv::Point(x, y), Constants::syntheticFont, fontScale, color, strokeWidth, CV_AA);
+            const cv::Rect wordBox(x, y - wordSize.height, wordSize.width, wordSize.height + baseline);
+            box = box.area() == 0 ? wordBox : box | wordBox;
+            x += wordSize.width + glyphSize.width;
+        }
+        if(box.area() > 0)
+            boxes.push_back(box);
+    }
+    if(rotation != 0) {
+        const cv::Point2f center(width / 2.0f, height / 2.0f);
+        const cv::Mat rotationMatrix = cv::getRotationMatrix2D(center, rotation, 1.0);
+        cv::Mat rotated;
+        cv::warpAffine(page, rotated, rotationMatrix, page.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(255, 255, 255));
+        page = rotated;
+        for(std::vector<cv::Rect>::iterator i = boxes.begin(); i != boxes.end(); ++i) {
+            const cv::RotatedRect rotatedBox(
+                cv::Point2f(i->x + i->width / 2.0f, i->y + i->height / 2.0f), cv::Size2f(i->width, i->height), 0);
+            cv::Point2f corners[4];
+            rotatedBox.points(corners);
+            std::vector<cv::Point> transformedCorners;
+            for(int j = 0; j != 4; ++j) {
+                const double* m = rotationMatrix.ptr<double>(0);
+                const double* n = rotationMatrix.ptr<double>(1);
+                transformedCorners.push_back(cv::Point(
+                    m[0] * corners[j].x + m[1] * corners[j].y + m[2],
+                    n[0] * corners[j].x + n[1] * corners[j].y + n[2]));
+            }
+            *i = cv::boundingRect(cv::Mat(transformedCorners)) & cv::Rect(0, 0, width, height);
+        }
+    }
+    if(noise > 0) {
+        cv::Mat noisyPage(page.size(), CV_16SC3);
+        rng.fill(noisyPage, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(noise));
+        cv::Mat widePage;
+        page.convertTo(widePage, CV_16SC3);
+        cv::add(widePage, noisyPage, noisyPage);
+        noisyPage.convertTo(page, CV_8UC3);
+    }
+    if(lineBoxes != NULL)
+        *lineBoxes = boxes;
+    return page;
+}
+
+SyntheticBars::SyntheticBars() :
+    size(640, 480),
+    strokeWidth(3),
+    spacing(24)
+    {}
+
+std::string SyntheticBars::describe() const
+{
+    std::stringstream description;
+    description<<"bars "<<size.width<<'x'<<size.height<<" stroke="<<strokeWidth<<" spacing="<<spacing;
+    return description.str();
+}
+
+/*
+    bars receives the rectangle of every bar.
+*/
+cv::Mat SyntheticBars::render(std::vector<cv::Rect>* bars) const
+{
+    cv::Mat page(size, CV_8UC3, cv::Scalar(255, 255, 255));
+    const int margin = spacing;
+    std::vector<cv::Rect> rects;
+    for(int i = 0; margin + i * spacing + strokeWidth + 8 < size.height - margin; ++i) {
+        rects.push_back(cv::Rect(margin, margin + i * spacing + (2 * i + 1) % 8, size.width / 2 - 2 * margin, strokeWidth));
+    }
+    for(int i = 0; size.width / 2 + margin + i * spacing + strokeWidth + 8 < size.width - margin; ++i) {
+        rects.push_back(cv::Rect(size.width / 2 + margin + i * spacing + (2 * i + 1) % 8, margin, strokeWidth, size.height - 2 * margin));
+    }
+    for(std::vector<cv::Rect>::const_iterator i = rects.begin(); i != rects.end(); ++i) {
+        cv::rectangle(page, i->tl(), i->br() - cv::Point(1, 1), cv::Scalar(0, 0, 0), -1);
+    }
+    if(bars != NULL)
+        *bars = rects;
+    return page;
+}
@@ -0,0 +1,37 @@
+#include <string>
+#include <vector>
+#include <opencv/cv.h>
+
+/*
+    Renders reproducible text images with cv::putText. Dark lines of
+    pseudo words on white paper, optionally rotated and noisy.
+*/
+class SyntheticText {
+public:
+    double megapixels;
+    double fontScale;
+    int strokeWidth;
+    double rotation;
+    double density;
+    double noise;
+    unsigned int seed;
+    cv::Mat render(std::vector<cv::Rect>* lineBoxes = NULL) const;
+    std::string describe() const;
+    SyntheticText();
+};
+
+/*
+    Renders dark axis aligned bars on white paper, horizontal ones on the
+    left half and vertical ones on the right, each starting on another
+    odd row or column. Sampling tied to pixel positions misses some of
+    them entirely.
+*/
+class SyntheticBars {
+public:
+    cv::Size size;
+    int strokeWidth;
+    int spacing;
+    cv::Mat render(std::vector<cv::Rect>* bars = NULL) const;
+    std::string describe() const;
+    SyntheticBars();
+};
@@ -0,0 +1,191 @@
+#include "generator.hpp"
+#include "../config.hpp"
+#include "../pictures.hpp"
+#include "../ray.hpp"
+#include "../component.hpp"
+#include "../profiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace Constants {
+    const char* const benchStages[] = {
+        "init", "buildLimitMap", "collectEdges", "buildRays", "drawRays", "findAll",
+        "identifyLetterCandidates", "identifyLineCandidates", "pipeline"
+    };
+    const int benchStageCount = sizeof(benchStages)/sizeof(char*);
+    const int minimumRepetitions = 5;
+    const int maximumRepetitions = 50;
+    const double targetRelativeError = 0.01;
+}
+
+/*
+    Runs every stage once and appends its seconds to samples, in the order
+    of Constants::benchStages. Returns the number of edge pixels.
+*/
+int runPipeline(const cv::Mat& page, const cv::Mat& grayPage, std::vector<std::vector<double> >& samples)
+{
+    double times[Constants::benchStageCount + 1];
+    const Config::Parameters& parameters = Config::parameters;
+    times[0] = Profiler::now();
+    Pictures::initialize(page, grayPage);
+    times[1] = Profiler::now();
+    std::vector<Contour*> contours;
+    const std::vector<std::vector<Contour*> > contourLimitMap = Contour::buildLimitMap(Pictures::canny, contours, parameters);
+    times[2] = Profiler::now();
+    const std::vector<EdgePixel> edges = EdgePixel::collect(contourLimitMap);
+    times[3] = Profiler::now();
+    std::list<Ray*> rays = Ray::buildRays(edges, parameters, Ray::bothDirections);
+    times[4] = Profiler::now();
+    Ray::drawRays(rays);
+    times[5] = Profiler::now();
+    const std::list<Component*> components = Component::findAll(parameters);
+    times[6] = Profiler::now();
+    const std::set<const std::vector<Component*>*> equivalenceClasses = Component::collectEquivalenceClasses(components);
+    std::vector<LetterCandidate*> letterCandidates = Component::identifyLetterCandidates(equivalenceClasses, parameters);
+    times[7] = Profiler::now();
+    const std::vector<LineCandidate*> lineCandidates = LetterCandidate::identifyLineCandidates(letterCandidates, parameters);
+    times[8] = Profiler::now();
+    for(int i = 0; i != Constants::benchStageCount - 1; ++i) {
+        samples[i].push_back(times[i + 1] - times[i]);
+    }
+    samples[Constants::benchStageCount - 1].push_back(times[Constants::benchStageCount - 1] - times[0]);
+
+    const int edgePixels = edges.size();
+    LetterCandidate::release(letterCandidates, lineCandidates);
+    Component::release(components, equivalenceClasses);
+    Ray::release(rays);
+    for(std::vector<Contour*>::const_iterator i = contours.begin(); i != contours.end(); ++i) {
+        delete *i;
+    }
+    return edgePixels;
+}
+
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+double relativeStandardError(const std::vector<double>& values)
+{
+    double sum = 0, squareSum = 0;
+    for(std::vector<double>::const_iterator i = values.begin(); i != values.end(); ++i) {
+        sum += *i;
+        squareSum += *i * *i;
+    }
+    const double mean = sum / values.size();
+    const double variance = std::max(0.0, squareSum / values.size() - mean * mean);
+    return mean == 0 ? 0 : std::sqrt(variance / values.size()) / mean;
+}
+
+/*
+    Repeats the pipeline until the standard error of the whole pipeline is
+    below one percent of its mean, within the repetition limits or the
+    time budget. The first run warms up caches and is discarded.
+*/
+void benchmark(const SyntheticText& text, const double secondsBudget)
+{
+    const cv::Mat page = text.render();
+    cv::Mat grayPage;
+    cv::cvtColor(page, grayPage, CV_BGR2GRAY);
+    std::vector<std::vector<double> > samples(Constants::benchStageCount);
+    runPipeline(page, grayPage, samples);
+    samples = std::vector<std::vector<double> >(Constants::benchStageCount);
+    const double start = Profiler::now();
+    int edgePixels = 0;
+    int repetitions = 0;
+    while(repetitions < Constants::maximumRepetitions) {
+        edgePixels = runPipeline(page, grayPage, samples);
+        ++repetitions;
+        if(repetitions < Constants::minimumRepetitions && Profiler::now() - start < secondsBudget)
+            continue;
+        if(relativeStandardError(samples.back()) < Constants::targetRelativeError || Profiler::now() - start >= secondsBudget)
+            break;
+    }
+    const double pixels = page.cols * page.rows;
+    std::cout<<text.describe()<<" ("<<page.cols<<'x'<<page.rows<<", "<<edgePixels<<" edge pixels, "<<repetitions<<" repetitions)\n";
+    for(int i = 0; i != Constants::benchStageCount; ++i) {
+        const double seconds = median(samples[i]);
+        std::cout<<"  "<<std::left<<std::setw(26)<<Constants::benchStages[i]<<std::right
+            <<std::fixed<<std::setprecision(3)<<std::setw(10)<<seconds * 1000<<" ms"
+            <<std::setprecision(1)<<std::setw(7)<<relativeStandardError(samples[i]) * 100<<" %"
+            <<std::setprecision(2)<<std::setw(10)<<(seconds > 0 ? pixels / seconds / 1000000 : 0)<<" MP/s"
+            <<std::setw(10)<<(seconds > 0 ? edgePixels / seconds / 1000000 : 0)<<" Medges/s\n";
+    }
+}
+
+std::vector<double> parseList(const std::string& list)
+{
+    std::vector<double> values;
+    std::stringstream stream(list);
+    std::string value;
+    while(std::getline(stream, value, ',')) {
+        values.push_back(std::atof(value.c_str()));
+    }
+    return values;
+}
+
+/*
+    Varies one property of the baseline text at a time. --megapixels
+    overrides the resolution sweep, --seconds the time budget per scenario.
+*/
+int main(const int argc, const char** argv)
+{
+    std::vector<double> megapixels = parseList("1,4,16,50");
+    double secondsBudget = 20;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        const std::string option = argv[i];
+        if(option == "--megapixels")
+            megapixels = parseList(argv[i + 1]);
+        else if(option == "--seconds")
+            secondsBudget = std::atof(argv[i + 1]);
+    }
+    try {
+        Config::readConfigFile();
+    } catch (const char* e) {
+        std::cerr<<e<<std::endl<<"Aborting…\n";
+        return -1;
+    }
+#ifdef TILED_PICTURES
+    std::cout<<"tiled layout\n";
+#else
+    std::cout<<"row-major layout\n";
+#endif
+    const SyntheticText baseline;
+    std::vector<SyntheticText> scenarios;
+    for(std::vector<double>::const_iterator i = megapixels.begin(); i != megapixels.end(); ++i) {
+        SyntheticText text = baseline;
+        text.megapixels = *i;
+        scenarios.push_back(text);
+    }
+    const double fontScales[] = {0.5, 2};
+    const int strokeWidths[] = {1, 4};
+    const double rotations[] = {10, 30};
+    const double densities[] = {0.1, 0.6};
+    const double noises[] = {10, 30};
+    for(int i = 0; i != 2; ++i) {
+        SyntheticText text = baseline;
+        text.fontScale = fontScales[i];
+        scenarios.push_back(text);
+        text = baseline;
+        text.strokeWidth = strokeWidths[i];
+        scenarios.push_back(text);
+        text = baseline;
+        text.rotation = rotations[i];
+        scenarios.push_back(text);
+        text = baseline;
+        text.density = densities[i];
+        scenarios.push_back(text);
+        text = baseline;
+        text.noise = noises[i];
+        scenarios.push_back(text);
+    }
+    for(std::vector<SyntheticText>::const_iterator i = scenarios.begin(); i != scenarios.end(); ++i) {
+        benchmark(*i, secondsBudget);
+    }
+    return 0;
+}
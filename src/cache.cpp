@@ -0,0 +1,245 @@
+#include "cache.hpp"
+#include "candidate.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+namespace Constants {
+    const unsigned int artifactVersion = 2;
+    const char strokesMagic[4] = {'O', 'S', 'S', 'T'};
+    const char lettersMagic[4] = {'O', 'S', 'L', 'C'};
+}
+
+/*
+    rows and columns of a stroke map, the number of records of a letter
+    candidate table.
+*/
+struct ArtifactHeader {
+    char magic[4];
+    unsigned int version;
+    unsigned int elementSize;
+    unsigned int rows;
+    unsigned int cols;
+    unsigned int padding;
+};
+
+struct LetterCandidateRecord {
+    float averageStrokeWidth;
+    int numberOfPixels;
+    int averageColor[3];
+    int x, y, width, height;
+};
+
+MappedFile::MappedFile(const std::string& fileName) :
+    data(MAP_FAILED),
+    size(0)
+{
+    const int descriptor = open(fileName.c_str(), O_RDONLY);
+    if(descriptor < 0)
+        throw "Could not open cached artifact.";
+    struct stat status;
+    if(fstat(descriptor, &status) == 0 && status.st_size > 0) {
+        size = status.st_size;
+        // private and writable, so a stroke map can be handed to code expecting writable pictures
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+    }
+    close(descriptor);
+    if(data == MAP_FAILED)
+        throw "Could not map cached artifact.";
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(data, size);
+}
+
+ArtifactCache::ArtifactCache(const std::string& directory, const Config::Parameters& parameters) :
+    directory(directory),
+    strokesKey(ArtifactCache::hash(ArtifactCache::describeStrokes(parameters))),
+    lettersKey(ArtifactCache::hash(ArtifactCache::describeLetterCandidates(parameters)))
+{
+    mkdir(directory.c_str(), 0777);
+}
+
+/*
+    Everything a stage's result depends on goes into its key, including
+    the build options that change it.
+*/
+std::string ArtifactCache::describeStrokes(const Config::Parameters& parameters)
+{
+    std::stringstream strokes;
+    strokes<<Constants::artifactVersion<<' '<<sizeof(StrokeValue)
+        <<' '<<parameters.apertureSize<<' '<<parameters.cannyThreshold1<<' '<<parameters.cannyThreshold2<<' '<<parameters.accurateCanny
+        <<' '<<parameters.contourSizeLimit<<' '<<parameters.maxStrokeWidth<<' '<<parameters.maxStrokeAngle
+        <<' '<<parameters.autoStrokeWidthPercentile<<' '<<parameters.autoStrokeWidthFactor
+        <<' '<<parameters.adaptiveShearing<<' '<<parameters.adaptiveShearingFactor<<' '<<parameters.rayDensity
+        <<' '<<parameters.textureTileSize<<' '<<parameters.textureEdgeDensity<<' '<<parameters.textureOrientationEntropy<<' '<<parameters.textureSpacingVariation
+        <<' '<<parameters.textPolarity<<' '<<parameters.polarityMargin;
+    for(std::vector<int>::const_iterator i = parameters.shearingAngles.begin(); i != parameters.shearingAngles.end(); ++i) {
+        strokes<<','<<*i;
+    }
+#ifdef NO_CONTOURS
+    strokes<<" NO_CONTOURS";
+#endif
+    return strokes.str();
+}
+
+std::string ArtifactCache::describeLetterCandidates(const Config::Parameters& parameters)
+{
+    std::stringstream letters;
+    letters<<ArtifactCache::describeStrokes(parameters)
+        <<' '<<parameters.groupingThreshold<<' '<<parameters.minLetterHeight<<' '<<parameters.maxStrokeVariance<<' '<<parameters.decodeGrayscale;
+    return letters.str();
+}
+
+std::vector<uchar> ArtifactCache::read(const std::string& fileName)
+{
+    std::ifstream stream(fileName.c_str(), std::ifstream::binary);
+    if(!stream.is_open())
+        throw "Could not read inputfile.";
+    return std::vector<uchar>((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+}
+
+/*
+    64 bit FNV-1a as 16 hex digits.
+*/
+std::string ArtifactCache::hash(const std::string& text)
+{
+    return ArtifactCache::hash(text.data(), text.size());
+}
+
+std::string ArtifactCache::hash(const char* data, const size_t size)
+{
+    unsigned long long value = 14695981039346656037ULL;
+    for(size_t i = 0; i != size; ++i) {
+        value ^= (unsigned char) data[i];
+        value *= 1099511628211ULL;
+    }
+    std::stringstream hex;
+    hex<<std::hex<<std::setw(16)<<std::setfill('0')<<value;
+    return hex.str();
+}
+
+std::string ArtifactCache::fileName(const std::string& imageHash, const std::string& key, const char* extension) const
+{
+    return std::string(directory).append("/").append(imageHash).append("-").append(key).append(extension);
+}
+
+/*
+    Written under a name of its own and renamed, so concurrent runs never
+    see half a file.
+*/
+void ArtifactCache::write(const std::string& fileName, const char* header, const size_t headerSize, const char* data, const size_t dataSize)
+{
+    std::stringstream temporaryFileName;
+    temporaryFileName<<fileName<<'.'<<getpid()<<'.'<<std::this_thread::get_id();
+    std::ofstream stream(temporaryFileName.str().c_str(), std::ofstream::binary | std::ofstream::trunc);
+    stream.write(header, headerSize);
+    stream.write(data, dataSize);
+    stream.close();
+    if(!stream || std::rename(temporaryFileName.str().c_str(), fileName.c_str()) != 0)
+        std::remove(temporaryFileName.str().c_str());
+}
+
+bool ArtifactCache::loadStrokes(const std::string& imageHash, cv::Mat_<StrokeValue>& strokes, MappedFile*& mapping) const
+{
+    try {
+        mapping = new MappedFile(fileName(imageHash, strokesKey, ".strokes"));
+    } catch (const char* e) {
+        mapping = NULL;
+        return false;
+    }
+    ArtifactHeader header;
+    std::memcpy(&header, mapping->begin(), std::min(sizeof(header), mapping->length()));
+    if(mapping->length() < sizeof(header)
+        || std::memcmp(header.magic, Constants::strokesMagic, 4) != 0
+        || header.version != Constants::artifactVersion
+        || header.elementSize != sizeof(StrokeValue)
+        || mapping->length() != sizeof(header) + (size_t) header.rows * header.cols * sizeof(StrokeValue)) {
+        delete mapping;
+        mapping = NULL;
+        return false;
+    }
+    strokes = cv::Mat_<StrokeValue>(header.rows, header.cols, (StrokeValue*) (mapping->begin() + sizeof(header)));
+    return true;
+}
+
+void ArtifactCache::storeStrokes(const std::string& imageHash, const cv::Mat_<StrokeValue>& strokes) const
+{
+    const cv::Mat_<StrokeValue> continuous = strokes.isContinuous() ? strokes : strokes.clone();
+    ArtifactHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Constants::strokesMagic, 4);
+    header.version = Constants::artifactVersion;
+    header.elementSize = sizeof(StrokeValue);
+    header.rows = continuous.rows;
+    header.cols = continuous.cols;
+    ArtifactCache::write(fileName(imageHash, strokesKey, ".strokes"), (const char*) &header, sizeof(header),
+        (const char*) continuous.data, continuous.total() * sizeof(StrokeValue));
+}
+
+bool ArtifactCache::loadLetterCandidates(const std::string& imageHash, std::vector<LetterCandidate*>& letterCandidates) const
+{
+    MappedFile* mapping;
+    try {
+        mapping = new MappedFile(fileName(imageHash, lettersKey, ".letters"));
+    } catch (const char* e) {
+        return false;
+    }
+    ArtifactHeader header;
+    std::memcpy(&header, mapping->begin(), std::min(sizeof(header), mapping->length()));
+    const bool valid = mapping->length() >= sizeof(header)
+        && std::memcmp(header.magic, Constants::lettersMagic, 4) == 0
+        && header.version == Constants::artifactVersion
+        && header.elementSize == sizeof(LetterCandidateRecord)
+        && mapping->length() == sizeof(header) + (size_t) header.rows * sizeof(LetterCandidateRecord);
+    if(valid) {
+        const LetterCandidateRecord* const records = (const LetterCandidateRecord*) (mapping->begin() + sizeof(header));
+        letterCandidates.reserve(header.rows);
+        for(const LetterCandidateRecord* i = records; i != records + header.rows; ++i) {
+            letterCandidates.push_back(new LetterCandidate(
+                i->averageStrokeWidth,
+                cv::Vec3i(i->averageColor[0], i->averageColor[1], i->averageColor[2]),
+                i->numberOfPixels,
+                cv::Rect(i->x, i->y, i->width, i->height)));
+        }
+    }
+    delete mapping;
+    return valid;
+}
+
+void ArtifactCache::storeLetterCandidates(const std::string& imageHash, const std::vector<LetterCandidate*>& letterCandidates) const
+{
+    std::vector<LetterCandidateRecord> records;
+    records.reserve(letterCandidates.size());
+    for(std::vector<LetterCandidate*>::const_iterator i = letterCandidates.begin(); i != letterCandidates.end(); ++i) {
+        LetterCandidateRecord record;
+        record.averageStrokeWidth = (*i)->averageStrokeWidth;
+        record.numberOfPixels = (*i)->numberOfPixels;
+        for(int channel = 0; channel != 3; ++channel) {
+            record.averageColor[channel] = (*i)->averageColor[channel];
+        }
+        record.x = (*i)->boundingRect.x;
+        record.y = (*i)->boundingRect.y;
+        record.width = (*i)->boundingRect.width;
+        record.height = (*i)->boundingRect.height;
+        records.push_back(record);
+    }
+    ArtifactHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Constants::lettersMagic, 4);
+    header.version = Constants::artifactVersion;
+    header.elementSize = sizeof(LetterCandidateRecord);
+    header.rows = records.size();
+    header.cols = 1;
+    ArtifactCache::write(fileName(imageHash, lettersKey, ".letters"), (const char*) &header, sizeof(header),
+        (const char*) records.data(), records.size() * sizeof(LetterCandidateRecord));
+}
@@ -0,0 +1,56 @@
+#ifndef OCTOSHARK_CACHE_HPP
+#define OCTOSHARK_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <opencv/cv.h>
+#include "config.hpp"
+#include "pictures.hpp"
+
+class LetterCandidate;
+
+/*
+    A file mapped into memory as a private, writable copy: writes stay in
+    memory and never reach the file. Unmapped with the object.
+*/
+class MappedFile {
+    void* data;
+    size_t size;
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+public:
+    const char* begin() const { return (const char*) data; };
+    size_t length() const { return size; };
+    MappedFile(const std::string& fileName);
+    ~MappedFile();
+};
+
+/*
+    Stroke maps and letter candidate tables of images, keyed by a hash of
+    the image file and of every parameter of the stages that produced
+    them. The files are raw arrays behind a small header: stroke maps are
+    used straight from the mapped file and letter candidates are built from
+    the mapped records. A run that only changes line grouping parameters
+    skips everything up to the letter candidates, one that changes letter
+    candidate parameters still skips ray casting.
+*/
+class ArtifactCache {
+    const std::string directory;
+    const std::string strokesKey;
+    const std::string lettersKey;
+    std::string fileName(const std::string& imageHash, const std::string& key, const char* extension) const;
+    static std::string describeStrokes(const Config::Parameters& parameters);
+    static std::string describeLetterCandidates(const Config::Parameters& parameters);
+    static void write(const std::string& fileName, const char* header, const size_t headerSize, const char* data, const size_t dataSize);
+public:
+    ArtifactCache(const std::string& directory, const Config::Parameters& parameters);
+    static std::vector<uchar> read(const std::string& fileName);
+    static std::string hash(const char* data, const size_t size);
+    static std::string hash(const std::string& text);
+    bool loadStrokes(const std::string& imageHash, cv::Mat_<StrokeValue>& strokes, MappedFile*& mapping) const;
+    void storeStrokes(const std::string& imageHash, const cv::Mat_<StrokeValue>& strokes) const;
+    bool loadLetterCandidates(const std::string& imageHash, std::vector<LetterCandidate*>& letterCandidates) const;
+    void storeLetterCandidates(const std::string& imageHash, const std::vector<LetterCandidate*>& letterCandidates) const;
+};
+
+#endif
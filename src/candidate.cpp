@@ -1,5 +1,6 @@
 #include "candidate.hpp"
 #include "pictures.hpp"
+#include <map>
 #include <set>
 #include <cmath>
 #include <iostream>
@@ -7,7 +8,8 @@
 namespace Constants {
     const int xDirection = 1;
     const int yDirection = 2;
-    const unsigned int minimumLineSize = 2;
+    // x and y along and across the dominant axis of each connection
+    const int majorAxisDirection = 3;
 }
 
 inline bool orderLetterCandidatesX(const LetterCandidate* const a, const LetterCandidate* const b)
@@ -25,17 +27,26 @@ inline bool orderLetterCandidatesCenter(const LetterCandidate* const a, const Le
     return a->center.x < b->center.x;
 }
 
+inline bool orderLetterCandidatesCenterY(const LetterCandidate* const a, const LetterCandidate* const b)
+{
+    return a->center.y < b->center.y;
+}
+
 inline double normalizedAzimuthOf(cv::Point distance)
 {
     const double azimuth = atan2(distance.y, distance.x);
     return azimuth < 0 ? azimuth + M_PI : azimuth;
 }
 
-LetterCandidateConnection::LetterCandidateConnection(LetterCandidate* source, LetterCandidate* destination, int direction) :
+LetterCandidateConnection::LetterCandidateConnection(LetterCandidate* source, LetterCandidate* destination, int direction, const Config::Parameters& parameters) :
     source(source),
     destination(destination)
 {
-    this->value = 3 * abs(source->center.x - destination->center.x) + 7 * abs(source->center.y - destination->center.y);
+    int along = abs(source->center.x - destination->center.x);
+    int across = abs(source->center.y - destination->center.y);
+    if(direction == Constants::majorAxisDirection && across > along)
+        std::swap(along, across);
+    this->value = parameters.letterCandidateConnectionXWeight * along + parameters.letterCandidateConnectionYWeight * across;
 }
 
 bool LetterCandidateConnection::operator<(const LetterCandidateConnection& other) const
@@ -50,46 +61,61 @@ LetterCandidateGroup::LetterCandidateGroup(LetterCandidate* firstElement) :
     candidates.push_back(firstElement);
 }
 
-bool LetterCandidateGroup::checkAzimuthAgainst(const double otherAzimuth) const
+bool LetterCandidateGroup::checkAzimuthAgainst(const double otherAzimuth, const double maximumDifference) const
 {
     const double difference1 = fabs(this->azimuth - otherAzimuth);
     const double difference2 = M_PI - std::max(this->azimuth, otherAzimuth) + std::min(this->azimuth, otherAzimuth);
     const double azimuthDifference = std::min(difference1, difference2);
-    return azimuthDifference < M_PI_4/2;
+    return azimuthDifference < maximumDifference;
 }
 
-bool LetterCandidateGroup::canMergeWith(const LetterCandidateGroup* const other) const
+bool LetterCandidateGroup::canMergeWith(const LetterCandidateGroup* const other, const double maximumAzimuthDifference) const
 {
     if(this->candidates.size() == 1 && other->candidates.size() == 1)
         return true;
     if(this->candidates.size() == 1)
-        return other->canMergeWith(this);
+        return other->canMergeWith(this, maximumAzimuthDifference);
     if(other->candidates.size() > 1) //implicit: this->candidates.size() > 1
-        return this->checkAzimuthAgainst(other->azimuth);
+        return this->checkAzimuthAgainst(other->azimuth, maximumAzimuthDifference);
     //implicit: this->candidates.size() > 1 && other->candidates.size() = 1
     //implicit: this->candidates is sorted by orderLetterCandidatesCenter
     const cv::Point distanceToFront = this->candidates.front()->center - other->candidates.front()->center;
     const cv::Point distanceToBack = this->candidates.back()->center - other->candidates.front()->center;
-    return this->checkAzimuthAgainst(normalizedAzimuthOf(distanceToFront)) && this->checkAzimuthAgainst(normalizedAzimuthOf(distanceToBack));
+    return this->checkAzimuthAgainst(normalizedAzimuthOf(distanceToFront), maximumAzimuthDifference)
+        && this->checkAzimuthAgainst(normalizedAzimuthOf(distanceToBack), maximumAzimuthDifference);
 }
 
-void LetterCandidateGroup::mergeWith(LetterCandidateGroup* other)
+/*
+    Groups are sorted by x, unless alongMajorAxis and they are taller than
+    wide, then by y; front and back are the ends of the line either way.
+*/
+void LetterCandidateGroup::mergeWith(LetterCandidateGroup* other, const bool alongMajorAxis)
 {
+    if(other == this) return;
     if(other->candidates.size() > this->candidates.size())
-        return other->mergeWith(this);
+        return other->mergeWith(this, alongMajorAxis);
     this->candidates.reserve(this->candidates.size() + other->candidates.size());
     this->candidates.insert(this->candidates.end(), other->candidates.begin(), other->candidates.end());
     for(std::vector<LetterCandidate*>::iterator i = other->candidates.begin(); i != other->candidates.end(); ++i)
         (*i)->group = this;
-    //delete other;
+    delete other;
     std::sort(this->candidates.begin(), this->candidates.end(), orderLetterCandidatesCenter);
+    if(alongMajorAxis) {
+        int minY = this->candidates.front()->center.y, maxY = minY;
+        for(std::vector<LetterCandidate*>::const_iterator i = this->candidates.begin(); i != this->candidates.end(); ++i) {
+            minY = std::min(minY, (*i)->center.y);
+            maxY = std::max(maxY, (*i)->center.y);
+        }
+        if(maxY - minY > this->candidates.back()->center.x - this->candidates.front()->center.x)
+            std::stable_sort(this->candidates.begin(), this->candidates.end(), orderLetterCandidatesCenterY);
+    }
     this->azimuth = normalizedAzimuthOf(this->candidates.back()->center - this->candidates.front()->center);
 }
 
-LineCandidate* LetterCandidateGroup::buildLineCandidate()
+LineCandidate* LetterCandidateGroup::buildLineCandidate(const unsigned int minimumLineSize)
 {
     if(this->hasBeenSelected) return NULL;
-    if(this->candidates.size() < Constants::minimumLineSize) return NULL;
+    if(this->candidates.size() < minimumLineSize) return NULL;
     this->hasBeenSelected = true;
     return new LineCandidate(this);
 }
@@ -118,7 +144,7 @@ cv::RotatedRect LineCandidate::getRotatedBoundingRect() const
    return result;
 }
 
-std::vector<LineCandidate*> LineCandidate::selectCandidates(std::vector<LetterCandidate*>& letterCandidates, std::vector<LetterCandidateConnection>& connectionsX, std::vector<LetterCandidateConnection>& connectionsY)
+std::vector<LineCandidate*> LineCandidate::selectCandidates(std::vector<LetterCandidate*>& letterCandidates, std::vector<LetterCandidateConnection>& connectionsX, std::vector<LetterCandidateConnection>& connectionsY, const Config::Parameters& parameters)
 {
     std::vector<LineCandidate*> result;
     std::vector<LetterCandidateConnection> connections;
@@ -127,10 +153,10 @@ std::vector<LineCandidate*> LineCandidate::selectCandidates(std::vector<LetterCa
     connections.insert(connections.end(), connectionsY.begin(), connectionsY.end());
     std::sort(connections.begin(), connections.end());
     for(std::vector<LetterCandidateConnection>::const_iterator i = connections.begin(); i != connections.end(); ++i) {       
-        i->source->tryToConnectWith(*i->destination);
+        i->source->tryToConnectWith(*i->destination, parameters);
     }
     for(std::vector<LetterCandidate*>::const_iterator i = letterCandidates.begin(); i != letterCandidates.end(); ++i) {
-        LineCandidate* const newCandidate = (*i)->group->buildLineCandidate();
+        LineCandidate* const newCandidate = (*i)->group->buildLineCandidate(parameters.minLineSize);
         if(newCandidate != NULL) {
             result.push_back(newCandidate);
         }
@@ -150,35 +176,33 @@ LetterCandidate::LetterCandidate(const float averageStrokeWidth, const cv::Vec3i
     group = new LetterCandidateGroup(this);
 }
 
-bool LetterCandidate::hasSimilarStrokeWidth(const LetterCandidate& other) const
+bool LetterCandidate::hasSimilarStrokeWidth(const LetterCandidate& other, const Config::Parameters& parameters) const
 {
     const float strokeWidthRatio = std::max(this->averageStrokeWidth, other.averageStrokeWidth) / std::min(this->averageStrokeWidth, other.averageStrokeWidth);
-    return strokeWidthRatio < 2;
+    return strokeWidthRatio < parameters.maxStrokeWidthRatio;
 }
 
-bool LetterCandidate::hasSimilarProportions(const LetterCandidate& other) const
+bool LetterCandidate::hasSimilarProportions(const LetterCandidate& other, const Config::Parameters& parameters) const
 {
-    const float heightRatio = std::max(this->boundingRect.height, other.boundingRect.height) / std::min(this->boundingRect.height, other.boundingRect.height);
-    return heightRatio < 2;  
+    const float heightRatio = (float) std::max(this->boundingRect.height, other.boundingRect.height) / std::min(this->boundingRect.height, other.boundingRect.height);
+    return heightRatio < parameters.maxHeightRatio;
 } 
 
-bool LetterCandidate::hasSimilarColor(const LetterCandidate& other) const
+bool LetterCandidate::hasSimilarColor(const LetterCandidate& other, const Config::Parameters& parameters) const
 {
     const cv::Vec3i ownColor = this->averageColor;
     const cv::Vec3i otherColor = other.averageColor;
-    return abs(ownColor[0]-otherColor[0])+abs(ownColor[1]-otherColor[1])+abs(ownColor[2]-otherColor[2]) < 250;
+    return abs(ownColor[0]-otherColor[0])+abs(ownColor[1]-otherColor[1])+abs(ownColor[2]-otherColor[2]) < parameters.maxColorDifference;
 }
 
-bool LetterCandidate::isInConnectivitySectorOf(const LetterCandidate& other, const int direction) const
+bool LetterCandidate::isInConnectivitySectorOf(const LetterCandidate& other, const int direction, const Config::Parameters& parameters) const
 {
     switch(direction) {
         case Constants::xDirection:
-#ifdef HORIZONTAL_LINES_WITH_FRUSTUM
-            return 1 * this->center.x - other.center.x > 3 * (abs(other.center.y - this->center.y) - this->boundingRect.height / 2);
-#endif
-#ifdef HORIZONTAL_LINES_WITH_CONE
-            return 2 * this->center.x - other.center.x > HORIZONTAL_LINES_WITH_CONE * (abs(other.center.y - this->center.y) - this->boundingRect.height / 2);
-#endif
+            if(parameters.lineSector == Config::frustumSector)
+                return 1 * this->center.x - other.center.x > 3 * (abs(other.center.y - this->center.y) - this->boundingRect.height / 2);
+            if(parameters.lineSector == Config::coneSector)
+                return 2 * this->center.x - other.center.x > parameters.lineSectorCone * (abs(other.center.y - this->center.y) - this->boundingRect.height / 2);
             return this->center.x - other.center.x > abs(other.center.y - this->center.y);
         case Constants::yDirection:
             return this->center.y - other.center.y > abs(this->center.x - other.center.x);
@@ -188,33 +212,33 @@ bool LetterCandidate::isInConnectivitySectorOf(const LetterCandidate& other, con
     }
 }
 
-void LetterCandidate::tryToConnectWith(LetterCandidate& other)
+void LetterCandidate::tryToConnectWith(LetterCandidate& other, const Config::Parameters& parameters)
 {
 #ifdef DRAW_LETTER_CONNECTIONS    
     cv::line(Pictures::original, this->center, other.center, cv::Scalar(0,200,220), 1, CV_AA);
 #endif
     if((!this->hasOutgoingConnection) && (!other.hasIncomingConnection)) {
-        if(this->group->canMergeWith(other.group)) {
+        if(this->group->canMergeWith(other.group, parameters.maxAzimuthDifference)) {
 #ifdef DRAW_LETTER_GROUPS    
             cv::line(Pictures::original, this->center, other.center, cv::Scalar(0,200,40), 2, CV_AA);
 #endif
-            this->group->mergeWith(other.group);
+            this->group->mergeWith(other.group, parameters.lineSector == Config::graphSector);
             this->hasOutgoingConnection = other.hasIncomingConnection = true;
         }
     }
 }
 
 
-bool LetterCandidate::exceedsRangeOfByDirection(const LetterCandidate& other, const int direction) const
+bool LetterCandidate::exceedsRangeOfByDirection(const LetterCandidate& other, const int direction, const Config::Parameters& parameters) const
 {
     switch(direction) {
         case Constants::xDirection: {
             const int dx = this->boundingRect.tl().x - other.boundingRect.br().x;
-            return dx > this->averageStrokeWidth*5;
+            return dx > this->averageStrokeWidth * parameters.maxLetterDistXByStrokeWidth;
         }
         case Constants::yDirection: {
             const int dy = this->boundingRect.tl().y - other.boundingRect.br().y;
-            return dy > this->averageStrokeWidth*5;
+            return dy > this->averageStrokeWidth * parameters.maxLetterDistYByStrokeWidth;
         }
         default:
             assert(false);
@@ -222,6 +246,21 @@ bool LetterCandidate::exceedsRangeOfByDirection(const LetterCandidate& other, co
     }    
 }
 
+/*
+    The gap between the bounding boxes along the dominant axis of the
+    centers, measured like exceedsRangeOfByDirection in that direction.
+*/
+bool LetterCandidate::exceedsRangeOf(const LetterCandidate& other, const Config::Parameters& parameters) const
+{
+    const float strokeWidth = std::max(this->averageStrokeWidth, other.averageStrokeWidth);
+    if(abs(this->center.x - other.center.x) >= abs(this->center.y - other.center.y)) {
+        const int dx = std::max(this->boundingRect.x, other.boundingRect.x) - std::min(this->boundingRect.br().x, other.boundingRect.br().x);
+        return dx > strokeWidth * parameters.maxLetterDistXByStrokeWidth;
+    }
+    const int dy = std::max(this->boundingRect.y, other.boundingRect.y) - std::min(this->boundingRect.br().y, other.boundingRect.br().y);
+    return dy > strokeWidth * parameters.maxLetterDistYByStrokeWidth;
+}
+
 void LetterCandidate::sortByDirection(std::vector<LetterCandidate*>& letterCandidates, const int direction)
 {
     switch(direction) {
@@ -237,36 +276,147 @@ void LetterCandidate::sortByDirection(std::vector<LetterCandidate*>& letterCandi
     }
 }
 
-std::vector<LetterCandidateConnection> LetterCandidate::computeNeighbourhood(std::vector<LetterCandidate*>& letterCandidates, const int direction)
+std::vector<LetterCandidateConnection> LetterCandidate::computeNeighbourhood(std::vector<LetterCandidate*>& letterCandidates, const int direction, const Config::Parameters& parameters)
 {
     std::vector<LetterCandidateConnection> connections;
-#if defined(HORIZONTAL_LINES_WITH_FRUSTUM) || defined (HORIZONTAL_LINES_WITH_FRUSTUM_WITH_CONE)
-    if(direction == Constants::yDirection)
+    if(parameters.lineSector == Config::frustumSector && direction == Constants::yDirection)
         return connections;
-#endif
     connections.reserve(letterCandidates.size()); // mal quadrat ausprobieren
     LetterCandidate::sortByDirection(letterCandidates, direction);
     for(std::vector<LetterCandidate*>::const_iterator i = letterCandidates.begin(); i != letterCandidates.end(); ++i) {
         std::vector<LetterCandidate*>::const_iterator j = i;
         ++j;
         for(;j != letterCandidates.end(); ++j) {
-            if((*j)->exceedsRangeOfByDirection(**i, direction)) break;
-            if((*j)->isInConnectivitySectorOf(**i, direction)
-                && (*i)->hasSimilarStrokeWidth(**j)
-                && (*i)->hasSimilarProportions(**j)
-                && (*i)->hasSimilarColor(**j)
+            if((*j)->exceedsRangeOfByDirection(**i, direction, parameters)) break;
+            if((*j)->isInConnectivitySectorOf(**i, direction, parameters)
+                && (*i)->hasSimilarStrokeWidth(**j, parameters)
+                && (*i)->hasSimilarProportions(**j, parameters)
+                && (*i)->hasSimilarColor(**j, parameters)
             ){
-                connections.push_back(LetterCandidateConnection(*i, *j, direction));
+                connections.push_back(LetterCandidateConnection(*i, *j, direction, parameters));
             }
         }
     }
     return connections;
 }
 
-std::vector<LineCandidate*> LetterCandidate::identifyLineCandidates(std::vector<LetterCandidate*>& letterCandidates)
+/*
+    The pairs of candidates whose centers are neighbours in the Delaunay
+    triangulation of all centers, which contains each candidate's nearest
+    neighbour. Candidates with the same center share a vertex and are
+    paired directly. Edges are taken from the edge list by their end
+    points, the vertices of the bounding triangle are no centers.
+*/
+std::vector<std::pair<LetterCandidate*, LetterCandidate*> > LetterCandidate::proximityPairs(const std::vector<LetterCandidate*>& letterCandidates)
+{
+    typedef std::pair<int, int> Center;
+    std::vector<std::pair<LetterCandidate*, LetterCandidate*> > pairs;
+    if(letterCandidates.size() < 2)
+        return pairs;
+    cv::Rect bounds(letterCandidates.front()->center.x, letterCandidates.front()->center.y, 1, 1);
+    std::map<Center, std::vector<LetterCandidate*> > candidatesAt;
+    for(std::vector<LetterCandidate*>::const_iterator i = letterCandidates.begin(); i != letterCandidates.end(); ++i) {
+        bounds |= cv::Rect((*i)->center.x, (*i)->center.y, 1, 1);
+        candidatesAt[Center((*i)->center.x, (*i)->center.y)].push_back(*i);
+    }
+    cv::Subdiv2D subdivision(bounds);
+    for(std::map<Center, std::vector<LetterCandidate*> >::const_iterator i = candidatesAt.begin(); i != candidatesAt.end(); ++i) {
+        subdivision.insert(cv::Point2f(i->first.first, i->first.second));
+        for(std::vector<LetterCandidate*>::const_iterator j = i->second.begin() + 1; j != i->second.end(); ++j) {
+            pairs.push_back(std::make_pair(i->second.front(), *j));
+        }
+    }
+    std::vector<cv::Vec4f> edgeList;
+    subdivision.getEdgeList(edgeList);
+    std::set<std::pair<Center, Center> > edges;
+    for(std::vector<cv::Vec4f>::const_iterator i = edgeList.begin(); i != edgeList.end(); ++i) {
+        const Center origin(cvRound((*i)[0]), cvRound((*i)[1]));
+        const Center destination(cvRound((*i)[2]), cvRound((*i)[3]));
+        if(candidatesAt.count(origin) != 0 && candidatesAt.count(destination) != 0 && origin != destination)
+            edges.insert(std::make_pair(std::min(origin, destination), std::max(origin, destination)));
+    }
+    for(std::set<std::pair<Center, Center> >::const_iterator edge = edges.begin(); edge != edges.end(); ++edge) {
+        const std::vector<LetterCandidate*>& origins = candidatesAt[edge->first];
+        const std::vector<LetterCandidate*>& destinations = candidatesAt[edge->second];
+        for(std::vector<LetterCandidate*>::const_iterator i = origins.begin(); i != origins.end(); ++i) {
+            for(std::vector<LetterCandidate*>::const_iterator j = destinations.begin(); j != destinations.end(); ++j) {
+                pairs.push_back(std::make_pair(*i, *j));
+            }
+        }
+    }
+    return pairs;
+}
+
+/*
+    Connections along the proximity pairs instead of sweeps along x and
+    y: O(n log n) pairs in every orientation at once. Sources are left of
+    their destinations, or above them for mostly vertical pairs, so lines
+    in any orientation become chains. Connections are weighted along and
+    across their own dominant axis, so steep neighbours rank like
+    horizontal ones.
+*/
+std::vector<LetterCandidateConnection> LetterCandidate::computeProximityGraph(const std::vector<LetterCandidate*>& letterCandidates, const Config::Parameters& parameters)
 {
-    std::vector<LetterCandidateConnection> connectionsX = LetterCandidate::computeNeighbourhood(letterCandidates, Constants::xDirection);
-    std::vector<LetterCandidateConnection> connectionsY = LetterCandidate::computeNeighbourhood(letterCandidates, Constants::yDirection);
-    std::vector<LineCandidate*> result = LineCandidate::selectCandidates(letterCandidates, connectionsX, connectionsY);
+    const std::vector<std::pair<LetterCandidate*, LetterCandidate*> > pairs = LetterCandidate::proximityPairs(letterCandidates);
+    std::vector<LetterCandidateConnection> connections;
+    connections.reserve(pairs.size());
+    for(std::vector<std::pair<LetterCandidate*, LetterCandidate*> >::const_iterator i = pairs.begin(); i != pairs.end(); ++i) {
+        LetterCandidate* source = i->first;
+        LetterCandidate* destination = i->second;
+        const cv::Point distance = destination->center - source->center;
+        if(abs(distance.x) >= abs(distance.y) ? distance.x < 0 : distance.y < 0)
+            std::swap(source, destination);
+        if(!destination->exceedsRangeOf(*source, parameters)
+            && source->hasSimilarStrokeWidth(*destination, parameters)
+            && source->hasSimilarProportions(*destination, parameters)
+            && source->hasSimilarColor(*destination, parameters)
+        ){
+            connections.push_back(LetterCandidateConnection(source, destination, Constants::majorAxisDirection, parameters));
+        }
+    }
+    return connections;
+}
+
+std::vector<LineCandidate*> LetterCandidate::identifyLineCandidates(std::vector<LetterCandidate*>& letterCandidates, const Config::Parameters& parameters)
+{
+    if(parameters.lineSector == Config::graphSector) {
+        std::vector<LetterCandidateConnection> connections = LetterCandidate::computeProximityGraph(letterCandidates, parameters);
+        std::vector<LetterCandidateConnection> none;
+        return LineCandidate::selectCandidates(letterCandidates, connections, none, parameters);
+    }
+    std::vector<LetterCandidateConnection> connectionsX = LetterCandidate::computeNeighbourhood(letterCandidates, Constants::xDirection, parameters);
+    std::vector<LetterCandidateConnection> connectionsY = LetterCandidate::computeNeighbourhood(letterCandidates, Constants::yDirection, parameters);
+    std::vector<LineCandidate*> result = LineCandidate::selectCandidates(letterCandidates, connectionsX, connectionsY, parameters);
     return result;
 }
+
+/*
+    Fresh candidates with the same measurements, for grouping the same
+    letters under several configurations at once.
+*/
+std::vector<LetterCandidate*> LetterCandidate::copy(const std::vector<LetterCandidate*>& letterCandidates)
+{
+    std::vector<LetterCandidate*> copies;
+    copies.reserve(letterCandidates.size());
+    for(std::vector<LetterCandidate*>::const_iterator i = letterCandidates.begin(); i != letterCandidates.end(); ++i) {
+        copies.push_back(new LetterCandidate((*i)->averageStrokeWidth, (*i)->averageColor, (*i)->numberOfPixels, (*i)->boundingRect));
+    }
+    return copies;
+}
+
+void LetterCandidate::release(const std::vector<LetterCandidate*>& letterCandidates, const std::vector<LineCandidate*>& lineCandidates)
+{
+    for(std::vector<LineCandidate*>::const_iterator i = lineCandidates.begin(); i != lineCandidates.end(); ++i) {
+        delete *i;
+    }
+    std::set<LetterCandidateGroup*> groups;
+    for(std::vector<LetterCandidate*>::const_iterator i = letterCandidates.begin(); i != letterCandidates.end(); ++i) {
+        groups.insert((*i)->group);
+    }
+    for(std::set<LetterCandidateGroup*>::const_iterator i = groups.begin(); i != groups.end(); ++i) {
+        delete *i;
+    }
+    for(std::vector<LetterCandidate*>::const_iterator i = letterCandidates.begin(); i != letterCandidates.end(); ++i) {
+        delete *i;
+    }
+}
@@ -1,4 +1,8 @@
+#ifndef OCTOSHARK_CANDIDATE_HPP
+#define OCTOSHARK_CANDIDATE_HPP
+
 #include <opencv/cv.h>
+#include "config.hpp"
 
 class LetterCandidate;
 class LineCandidate;
@@ -10,7 +14,7 @@ class LetterCandidateConnection {
     LetterCandidate* destination;
 public:
     bool operator<(const LetterCandidateConnection& other) const;
-    LetterCandidateConnection(LetterCandidate* source, LetterCandidate* destination, int direction);
+    LetterCandidateConnection(LetterCandidate* source, LetterCandidate* destination, int direction, const Config::Parameters& parameters);
 };
 
 class LetterCandidateGroup {
@@ -21,10 +25,10 @@ class LetterCandidateGroup {
 public:
     const std::vector<LetterCandidate*> getCandidates() const { return candidates; };
     double getAzimuth() const { return azimuth; };
-    bool checkAzimuthAgainst(const double otherAzimuth) const;
-    bool canMergeWith(const LetterCandidateGroup* const other) const;
-    void mergeWith(LetterCandidateGroup* other);
-    LineCandidate* buildLineCandidate();
+    bool checkAzimuthAgainst(const double otherAzimuth, const double maximumDifference) const;
+    bool canMergeWith(const LetterCandidateGroup* const other, const double maximumAzimuthDifference) const;
+    void mergeWith(LetterCandidateGroup* other, const bool alongMajorAxis);
+    LineCandidate* buildLineCandidate(const unsigned int minimumLineSize);
     LetterCandidateGroup(LetterCandidate* firstElement);
 };
 
@@ -36,7 +40,7 @@ public:
     const cv::Rect getBoundingRect() const { return boundingRect; };
     const LetterCandidateGroup* const getGroup() const { return group; };
     LineCandidate(LetterCandidateGroup* group);
-    static std::vector<LineCandidate*> selectCandidates(std::vector<LetterCandidate*>& letterCandidates, std::vector<LetterCandidateConnection>& connectionsX, std::vector<LetterCandidateConnection>& connectionsY);
+    static std::vector<LineCandidate*> selectCandidates(std::vector<LetterCandidate*>& letterCandidates, std::vector<LetterCandidateConnection>& connectionsX, std::vector<LetterCandidateConnection>& connectionsY, const Config::Parameters& parameters);
 };
 
 class LetterCandidate {
@@ -51,18 +55,22 @@ public:
     const cv::Vec3i averageColor;
     const cv::Rect boundingRect;
     const cv::Point center;
-    bool hasSimilarStrokeWidth(const LetterCandidate& other) const;
-    bool hasSimilarProportions(const LetterCandidate& other) const;
-    bool hasSimilarColor(const LetterCandidate& other) const;
-    bool exceedsRangeOfByDirection(const LetterCandidate& other, const int direction) const;
-    bool isInConnectivitySectorOf(const LetterCandidate& other, const int direction) const;
-    void tryToConnectWith(LetterCandidate& other);
+    bool hasSimilarStrokeWidth(const LetterCandidate& other, const Config::Parameters& parameters) const;
+    bool hasSimilarProportions(const LetterCandidate& other, const Config::Parameters& parameters) const;
+    bool hasSimilarColor(const LetterCandidate& other, const Config::Parameters& parameters) const;
+    bool exceedsRangeOfByDirection(const LetterCandidate& other, const int direction, const Config::Parameters& parameters) const;
+    bool exceedsRangeOf(const LetterCandidate& other, const Config::Parameters& parameters) const;
+    bool isInConnectivitySectorOf(const LetterCandidate& other, const int direction, const Config::Parameters& parameters) const;
+    void tryToConnectWith(LetterCandidate& other, const Config::Parameters& parameters);
     
     LetterCandidate(const float averageStrokeWidth, const cv::Vec3i averageColor, int numberOfPixels, const cv::Rect boundingRect);
     static void sortByDirection(std::vector<LetterCandidate*>& letterCandidates, const int direction);
-    static std::vector<LetterCandidateConnection> computeNeighbourhood(std::vector<LetterCandidate*>& letterCandidates, const int direction);
-    static std::vector<LineCandidate*> identifyLineCandidates(std::vector<LetterCandidate*>& letterCandidates);
+    static std::vector<LetterCandidateConnection> computeNeighbourhood(std::vector<LetterCandidate*>& letterCandidates, const int direction, const Config::Parameters& parameters);
+    static std::vector<std::pair<LetterCandidate*, LetterCandidate*> > proximityPairs(const std::vector<LetterCandidate*>& letterCandidates);
+    static std::vector<LetterCandidateConnection> computeProximityGraph(const std::vector<LetterCandidate*>& letterCandidates, const Config::Parameters& parameters);
+    static std::vector<LineCandidate*> identifyLineCandidates(std::vector<LetterCandidate*>& letterCandidates, const Config::Parameters& parameters);
+    static std::vector<LetterCandidate*> copy(const std::vector<LetterCandidate*>& letterCandidates);
+    static void release(const std::vector<LetterCandidate*>& letterCandidates, const std::vector<LineCandidate*>& lineCandidates);
 };
 
-
-
+#endif
@@ -1,15 +1,28 @@
 #include "config.hpp"
 #include "pictures.hpp"
 #include "component.hpp"
+#include "memory.hpp"
+#include "profiler.hpp"
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
+#if defined(__SSE2__) && !defined(WIDE_STROKES)
+#include <emmintrin.h>
+#endif
 
 namespace Constants {
     Component* nullComponent = (Component*) 0;
+    const uchar similarToLeft = 1;
+    const uchar similarToTopLeft = 2;
+    const uchar similarToTop = 4;
+    const uchar similarToTopRight = 8;
+    const uchar similarToNeighbours = 15;
+    const uchar topLeftSimilarToTopRight = 16;
+    const uchar leftSimilarToTopRight = 32;
 }
 
-inline cv::Vec3i sumOfScalars(cv::Vec3i& a, cv::Vec3b& b)
+inline cv::Vec3i sumOfScalars(cv::Vec3i& a, const cv::Vec3b& b)
 {
 	a[0] += b[0];
 	a[1] += b[1];
@@ -25,23 +38,58 @@ inline cv::Vec3i operator/ (cv::Vec3i& a, int divident)
 	return a;
 }
 
-std::vector<std::vector<Component*> > Component::map;
+thread_local std::vector<std::vector<Component*> > Component::map;
 // ungünstig, da dadurch nicht im caller initialisiert werden kann
-std::list<Component*> Component::list;
-float Component::groupingThreshold;
+thread_local std::list<Component*> Component::list;
+thread_local int Component::groupingThresholdNumerator;
+thread_local int Component::groupingThresholdDenominator;
 
-std::list<Component*> Component::findAll()
+/*
+    Stroke widths are integers below strokeBackground, so the smallest
+    fraction numerator/denominator of such integers that is not below the
+    threshold separates exactly the same ratios as the threshold itself.
+*/
+void Component::setGroupingThreshold(const float threshold)
+{
+    const int largest = Constants::strokeBackground - 1;
+    groupingThresholdNumerator = largest;
+    groupingThresholdDenominator = 1;
+    for(int denominator = 1; denominator <= largest; ++denominator) {
+        const double numerator = std::ceil((double) threshold * denominator);
+        if(numerator > largest)
+            break;
+        if((long long) numerator * groupingThresholdDenominator < (long long) groupingThresholdNumerator * denominator) {
+            groupingThresholdNumerator = numerator;
+            groupingThresholdDenominator = denominator;
+        }
+    }
+}
+
+/*
+    Stroke maps with few stroke pixels are labeled from their runs, others
+    pixel by pixel with precomputed similarity masks.
+*/
+std::list<Component*> Component::findAll(const Config::Parameters& parameters)
 {    
+    setGroupingThreshold(parameters.groupingThreshold);
+    if(parameters.sparseStrokeShare > 0) {
+        const StrokeRuns runs(Pictures::strokes);
+        if(runs.values.size() <= parameters.sparseStrokeShare * Pictures::strokes.total()) {
+            Profiler::count("strokeRuns", runs.runs.size());
+            Memory::count("strokeRuns", runs.allocatedBytes());
+            return Component::findAllInRuns(runs);
+        }
+    }
     map = std::vector<std::vector<Component*> >(
         Pictures::strokes.rows,
         std::vector<Component*>(
             Pictures::strokes.cols,
             Constants::nullComponent));
     list = std::list<Component*>();
-    groupingThreshold = (float) Config::variables["groupingThreshold1"] / Config::variables["groupingThreshold2"];
+    const cv::Mat_<uchar> similarities = Component::computeSimilarities(Pictures::strokes);
     for(int y=0; y<Pictures::strokes.rows; ++y) {
         for(int x=0; x<Pictures::strokes.cols; ++x) {
-            ConnectionTestRegion region(x, y);
+            ConnectionTestRegion region(x, y, similarities);
             region.connectAdjacentComponents();
             Component* current = region.calculateComponent();
             if(current != Constants::nullComponent)
@@ -52,6 +100,170 @@ std::list<Component*> Component::findAll()
     return list;
 }
 
+/*
+    Visits the same pixels in the same order as the dense labeling, minus
+    those without a stroke pixel among themselves and their left, top
+    left, top and top right neighbours, as nothing happens there. Only two
+    rows of widths and components are kept, padded by a background pixel
+    on both sides.
+*/
+std::list<Component*> Component::findAllInRuns(const StrokeRuns& runs)
+{
+    map = std::vector<std::vector<Component*> >();
+    list = std::list<Component*>();
+    std::vector<StrokeValue> previousWidths(runs.cols + 2, Constants::strokeBackground), currentWidths(runs.cols + 2, Constants::strokeBackground);
+    std::vector<Component*> previousComponents(runs.cols + 2, Constants::nullComponent), currentComponents(runs.cols + 2, Constants::nullComponent);
+    std::vector<std::pair<int, int> > spans;
+    for(int y = 0; y < runs.rows; ++y) {
+        spans.clear();
+        for(int i = runs.rowStarts[y]; i != runs.rowStarts[y + 1]; ++i) {
+            const StrokeRuns::Run& run = runs.runs[i];
+            std::copy(runs.values.begin() + run.offset, runs.values.begin() + run.offset + run.length, currentWidths.begin() + run.x + 1);
+            spans.push_back(std::make_pair(run.x, run.x + run.length + 1));
+        }
+        if(y > 0) {
+            for(int i = runs.rowStarts[y - 1]; i != runs.rowStarts[y]; ++i) {
+                spans.push_back(std::make_pair(runs.runs[i].x - 1, runs.runs[i].x + runs.runs[i].length + 1));
+            }
+        }
+        std::sort(spans.begin(), spans.end());
+        int visited = 0;
+        for(std::vector<std::pair<int, int> >::const_iterator span = spans.begin(); span != spans.end(); ++span) {
+            const int end = std::min(span->second, runs.cols);
+            for(int x = std::max(span->first, visited); x < end; ++x) {
+                const StrokeValue neighbours[] = {currentWidths[x], previousWidths[x], previousWidths[x + 1], previousWidths[x + 2]};
+                Component* const components[] = {currentComponents[x], previousComponents[x], previousComponents[x + 1], previousComponents[x + 2]};
+                ConnectionTestRegion region(x, y, currentWidths[x + 1], neighbours, components);
+                region.connectAdjacentComponents();
+                Component* current = region.calculateComponent();
+                if(current != Constants::nullComponent)
+                   current->updateBounds(x, y);
+                currentComponents[x + 1] = current;
+            }
+            visited = std::max(visited, end);
+        }
+        if(y > 0) {
+            for(int i = runs.rowStarts[y - 1]; i != runs.rowStarts[y]; ++i) {
+                const StrokeRuns::Run& run = runs.runs[i];
+                std::fill(previousWidths.begin() + run.x + 1, previousWidths.begin() + run.x + run.length + 1, Constants::strokeBackground);
+                std::fill(previousComponents.begin() + run.x + 1, previousComponents.begin() + run.x + run.length + 1, Constants::nullComponent);
+            }
+        }
+        previousWidths.swap(currentWidths);
+        previousComponents.swap(currentComponents);
+    }
+    return list;
+}
+
+StrokeRuns::StrokeRuns(const cv::Mat_<StrokeValue>& strokes) :
+    rows(strokes.rows),
+    cols(strokes.cols)
+{
+    rowStarts.reserve(rows + 1);
+    for(int y = 0; y < rows; ++y) {
+        rowStarts.push_back(runs.size());
+        const StrokeValue* const row = strokes[y];
+        for(int x = 0; x < cols; ++x) {
+            if(row[x] == Constants::strokeBackground)
+                continue;
+            Run run;
+            run.x = x;
+            run.offset = values.size();
+            while(x < cols && row[x] != Constants::strokeBackground) {
+                values.push_back(row[x]);
+                ++x;
+            }
+            run.length = x - run.x;
+            runs.push_back(run);
+        }
+    }
+    rowStarts.push_back(runs.size());
+}
+
+double StrokeRuns::allocatedBytes() const
+{
+    return (double) rowStarts.capacity() * sizeof(int) + runs.capacity() * sizeof(Run) + values.capacity() * sizeof(StrokeValue);
+}
+
+/*
+    The ratio of the larger to the smaller stroke width has to stay below
+    groupingThreshold, cross multiplied with its fraction to stay in
+    integers. Background never matches.
+*/
+bool Component::haveSimilarStrokeWidths(const StrokeValue a, const StrokeValue b)
+{
+    if(a == Constants::strokeBackground || b == Constants::strokeBackground)
+        return false;
+    return (long long) std::max(a, b) * groupingThresholdDenominator < (long long) groupingThresholdNumerator * std::min(a, b);
+}
+
+/*
+    Sets bit in masks[i] where a[i] and b[i] have similar stroke widths.
+    Sixteen pixels at a time with SSE2: the ratio test is cross multiplied
+    in 16 bit lanes, biased by 0x8000 for the signed compare.
+*/
+void Component::markSimilarPairs(const StrokeValue* a, const StrokeValue* b, const int count, uchar* masks, const uchar bit)
+{
+    int i = 0;
+#if defined(__SSE2__) && !defined(WIDE_STROKES)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i background = _mm_set1_epi8((char) Constants::strokeBackground);
+    const __m128i numerator = _mm_set1_epi16(groupingThresholdNumerator);
+    const __m128i denominator = _mm_set1_epi16(groupingThresholdDenominator);
+    const __m128i bias = _mm_set1_epi16((short) 0x8000);
+    const __m128i bits = _mm_set1_epi8(bit);
+    for(; i + 16 <= count; i += 16) {
+        const __m128i first = _mm_loadu_si128((const __m128i*) (a + i));
+        const __m128i second = _mm_loadu_si128((const __m128i*) (b + i));
+        const __m128i larger = _mm_max_epu8(first, second);
+        const __m128i smaller = _mm_min_epu8(first, second);
+        const __m128i lowLeft = _mm_xor_si128(_mm_mullo_epi16(_mm_unpacklo_epi8(larger, zero), denominator), bias);
+        const __m128i lowRight = _mm_xor_si128(_mm_mullo_epi16(_mm_unpacklo_epi8(smaller, zero), numerator), bias);
+        const __m128i highLeft = _mm_xor_si128(_mm_mullo_epi16(_mm_unpackhi_epi8(larger, zero), denominator), bias);
+        const __m128i highRight = _mm_xor_si128(_mm_mullo_epi16(_mm_unpackhi_epi8(smaller, zero), numerator), bias);
+        const __m128i similar = _mm_andnot_si128(
+            _mm_cmpeq_epi8(larger, background),
+            _mm_packs_epi16(_mm_cmplt_epi16(lowLeft, lowRight), _mm_cmplt_epi16(highLeft, highRight)));
+        const __m128i mask = _mm_loadu_si128((const __m128i*) (masks + i));
+        _mm_storeu_si128((__m128i*) (masks + i), _mm_or_si128(mask, _mm_and_si128(similar, bits)));
+    }
+#endif
+    for(; i < count; ++i) {
+        if(Component::haveSimilarStrokeWidths(a[i], b[i]))
+            masks[i] |= bit;
+    }
+}
+
+/*
+    For every pixel the similarity to its left, top left, top and top right
+    neighbour, plus the two neighbour pairs that no other pixel's mask
+    covers. Labeling then only reads these masks.
+*/
+cv::Mat_<uchar> Component::computeSimilarities(const cv::Mat_<StrokeValue>& strokes)
+{
+    cv::Mat_<uchar> similarities(strokes.size(), (uchar) 0);
+    const int cols = strokes.cols;
+    for(int y = 0; y < strokes.rows; ++y) {
+        const StrokeValue* const row = strokes[y];
+        uchar* const masks = similarities[y];
+        if(cols > 1)
+            markSimilarPairs(row + 1, row, cols - 1, masks + 1, Constants::similarToLeft);
+        if(y == 0)
+            continue;
+        const StrokeValue* const above = strokes[y - 1];
+        markSimilarPairs(row, above, cols, masks, Constants::similarToTop);
+        if(cols > 1) {
+            markSimilarPairs(row + 1, above, cols - 1, masks + 1, Constants::similarToTopLeft);
+            markSimilarPairs(row, above + 1, cols - 1, masks, Constants::similarToTopRight);
+        }
+        if(cols > 2) {
+            markSimilarPairs(above, above + 2, cols - 2, masks + 1, Constants::topLeftSimilarToTopRight);
+            markSimilarPairs(row, above + 2, cols - 2, masks + 1, Constants::leftSimilarToTopRight);
+        }
+    }
+    return similarities;
+}
+
 std::set<const std::vector<Component*>*> Component::collectEquivalenceClasses(const std::list<Component*>& components)
 {
     std::set<const std::vector<Component*>*> equivalenceClasses;
@@ -61,18 +273,16 @@ std::set<const std::vector<Component*>*> Component::collectEquivalenceClasses(co
     return equivalenceClasses;
 }
 
-std::vector<LetterCandidate*> Component::identifyLetterCandidates(const std::set<const std::vector<Component*>*>& equivalenceClasses)
+std::vector<LetterCandidate*> Component::identifyLetterCandidates(const std::set<const std::vector<Component*>*>& equivalenceClasses, const Config::Parameters& parameters)
 {
     std::vector<LetterCandidate*> result;
     result.reserve(equivalenceClasses.size());
-    const double maximumStrokeWidth = Config::variables["maximumStrokeWidth"]; //bad
-    const double maximumStrokeVariance = Config::variables["maximumStrokeVariance"];
     cv::Vec3i letterColor = cv::Vec3i(0,0,0);
     for(std::set<const std::vector<Component*> * >::iterator j = equivalenceClasses.begin(); j != equivalenceClasses.end(); ++j) {
         int minX, minY, maxX, maxY;
         double strokeWidthSum = 0;
         int pixelCount = 0;
-        std::list<float> strokeWidths = std::list<float>();
+        std::list<StrokeValue> strokeWidths = std::list<StrokeValue>();
         minX = minY = 9999999;
         maxX = maxY = -1;
         for(std::vector<Component*>::const_iterator i = (*j)->begin(); i != (*j)->end(); ++i) {
@@ -84,25 +294,36 @@ std::vector<LetterCandidate*> Component::identifyLetterCandidates(const std::set
             pixelCount += (*i)->getPixelCount();
             strokeWidths.splice(strokeWidths.begin(), (*i)->strokeWidths);
           
-            for(std::list<cv::Point>::iterator k = (*i)->coordinates.begin(); k != (*i)->coordinates.end(); ++k) {
-            	letterColor=sumOfScalars(letterColor, Pictures::original.at<cv::Vec3b>(k->y, k->x));
+            // single channel images give gray colors, intensity in every channel
+            if(Pictures::original.channels() == 1) {
+                int intensity = 0;
+                for(std::list<cv::Point>::iterator k = (*i)->coordinates.begin(); k != (*i)->coordinates.end(); ++k) {
+                    intensity += Pictures::original.at<uchar>(k->y, k->x);
+                }
+                letterColor[0] += intensity;
+                letterColor[1] += intensity;
+                letterColor[2] += intensity;
+            } else {
+                for(std::list<cv::Point>::iterator k = (*i)->coordinates.begin(); k != (*i)->coordinates.end(); ++k) {
+                    letterColor=sumOfScalars(letterColor, Pictures::original.at<cv::Vec3b>(k->y, k->x));
+                }
             }
         }
-        const double averageStrokeWidth = (strokeWidthSum / pixelCount) * maximumStrokeWidth;
+        const double averageStrokeWidth = strokeWidthSum / pixelCount;
         cv::Vec3i averageLetterColor = letterColor / pixelCount;
         double variance = 0;
-        for(std::list<float>::iterator i = strokeWidths.begin(); i != strokeWidths.end(); ++i) {
-            const double difference = averageStrokeWidth - maximumStrokeWidth * (*i);
+        for(std::list<StrokeValue>::iterator i = strokeWidths.begin(); i != strokeWidths.end(); ++i) {
+            const double difference = averageStrokeWidth - (*i);
             variance += difference * difference;
         }
         variance = variance / pixelCount;
         const double width = maxX-minX+1;
         const double height = maxY-minY+1;
-        if ( height > 8 
+        if ( height > parameters.minLetterHeight 
             // && height < 10*averageStrokeWidth 
             // && height > 2*averageStrokeWidth
             // && width < 10*averageStrokeWidth
-            // && variance <= maximumStrokeVariance
+            // && variance <= parameters.maxStrokeVariance
         ) {
 #ifdef DRAW_COMPONENTS
             cv::rectangle(Pictures::original, cv::Rect(minX, minY, width, height), cv::Scalar(0,0,255));
@@ -113,6 +334,31 @@ std::vector<LetterCandidate*> Component::identifyLetterCandidates(const std::set
     return result;
 }
 
+void Component::release(const std::list<Component*>& components, const std::set<const std::vector<Component*>*>& equivalenceClasses)
+{
+    for(std::set<const std::vector<Component*>*>::const_iterator i = equivalenceClasses.begin(); i != equivalenceClasses.end(); ++i) {
+        delete *i;
+    }
+    for(std::list<Component*>::const_iterator i = components.begin(); i != components.end(); ++i) {
+        delete *i;
+    }
+    map = std::vector<std::vector<Component*> >();
+    list = std::list<Component*>();
+}
+
+/*
+    The map, the components and a list node per pixel in strokeWidths and
+    coordinates. Labeling from runs has no map.
+*/
+double Component::allocatedBytes(const std::list<Component*>& components)
+{
+    double bytes = map.empty() ? 0 : Pictures::strokes.total() * (sizeof(Component*) + sizeof(uchar));
+    for(std::list<Component*>::const_iterator i = components.begin(); i != components.end(); ++i) {
+        bytes += sizeof(Component) + 3 * sizeof(void*) + (*i)->pixelCount * (4 * sizeof(void*) + sizeof(StrokeValue) + sizeof(cv::Point));
+    }
+    return bytes;
+}
+
 Component::Component(const ConnectionTestRegion& region) :
     minX(region.x),
     maxX(region.x),
@@ -123,7 +369,7 @@ Component::Component(const ConnectionTestRegion& region) :
 {
     this->equivalenceClass = new std::vector<Component*>();
     this->equivalenceClass->push_back(this);
-    this->strokeWidths = std::list<float>();
+    this->strokeWidths = std::list<StrokeValue>();
     this->strokeWidths.push_back(region.current);
     this->coordinates = std::list<cv::Point>();
     this->coordinates.push_back(cv::Point(region.x, region.y));
@@ -155,7 +401,7 @@ void Component::connectWith(Component& other)
     this->equivalenceClass->insert(this->equivalenceClass->end(), otherEquivalenceClass->begin(), otherEquivalenceClass->end());
     for(std::vector<Component*>::iterator i = otherEquivalenceClass->begin(); i != otherEquivalenceClass->end(); ++i)
         (*i)->equivalenceClass = this->equivalenceClass;
-    // delete otherEquivalenceClass;
+    delete otherEquivalenceClass;
 }
 
 bool Component::isConnectedWith(const Component& other) const
@@ -163,68 +409,115 @@ bool Component::isConnectedWith(const Component& other) const
     return (this == &other) || (this->equivalenceClass == other.equivalenceClass);
 }
 
-ConnectionTestRegion::ConnectionTestRegion(const int x, const int y) :
+ConnectionTestRegion::ConnectionTestRegion(const int x, const int y, const cv::Mat_<uchar>& similarities) :
     x(x),
     y(y),
-    current(Pictures::strokes.at<float>(y, x)),
-    left(x>0                                    ? Pictures::strokes.at<float>(y, x-1)   : Constants::strokeBackground),
-    topLeft(x>0 && y>0                          ? Pictures::strokes.at<float>(y-1, x-1) : Constants::strokeBackground),
-    top(y>0                                     ? Pictures::strokes.at<float>(y-1, x)   : Constants::strokeBackground),
-    topRight(y>0 && x<Pictures::strokes.cols-1  ? Pictures::strokes.at<float>(y-1, x+1) : Constants::strokeBackground),
+    current(Pictures::strokes(y, x)),
+    similarity(similarities(y, x)),
+    leftSimilarity(x>0                                      ? similarities(y, x-1)   : 0),
+    topSimilarity(y>0                                       ? similarities(y-1, x)   : 0),
+    topRightSimilarity(y>0 && x<Pictures::strokes.cols-1    ? similarities(y-1, x+1) : 0),
     leftComponent(x>0                                   ? Component::map[y][x-1]   : Constants::nullComponent),
     topLeftComponent(x>0 && y>0                         ? Component::map[y-1][x-1] : Constants::nullComponent),
     topComponent(y>0                                    ? Component::map[y-1][x]   : Constants::nullComponent),
     topRightComponent(y>0 && x<Pictures::strokes.cols-1 ? Component::map[y-1][x+1] : Constants::nullComponent)
     {}
 
+/*
+    A pixel of a run with the widths and components of its left, top left,
+    top and top right neighbour. The masks are what computeSimilarities
+    would have stored for it and for those neighbours.
+*/
+ConnectionTestRegion::ConnectionTestRegion(const int x, const int y, const StrokeValue current, const StrokeValue* neighbours, Component* const* components) :
+    leftComponent(components[0]),
+    topLeftComponent(components[1]),
+    topComponent(components[2]),
+    topRightComponent(components[3]),
+    x(x),
+    y(y),
+    current(current),
+    similarity(
+        (Component::haveSimilarStrokeWidths(current, neighbours[0]) ? Constants::similarToLeft : 0)
+        | (Component::haveSimilarStrokeWidths(current, neighbours[1]) ? Constants::similarToTopLeft : 0)
+        | (Component::haveSimilarStrokeWidths(current, neighbours[2]) ? Constants::similarToTop : 0)
+        | (Component::haveSimilarStrokeWidths(current, neighbours[3]) ? Constants::similarToTopRight : 0)
+        | (Component::haveSimilarStrokeWidths(neighbours[1], neighbours[3]) ? Constants::topLeftSimilarToTopRight : 0)
+        | (Component::haveSimilarStrokeWidths(neighbours[0], neighbours[3]) ? Constants::leftSimilarToTopRight : 0)),
+    leftSimilarity(
+        (Component::haveSimilarStrokeWidths(neighbours[0], neighbours[1]) ? Constants::similarToTop : 0)
+        | (Component::haveSimilarStrokeWidths(neighbours[0], neighbours[2]) ? Constants::similarToTopRight : 0)),
+    topSimilarity(Component::haveSimilarStrokeWidths(neighbours[2], neighbours[1]) ? Constants::similarToLeft : 0),
+    topRightSimilarity(Component::haveSimilarStrokeWidths(neighbours[3], neighbours[2]) ? Constants::similarToLeft : 0)
+    {}
+
 /*
     Mögliche Fälle sind:
     l&ol, l&o, l&or
     ol&o, ol&or
     o&or 
-    Achtung: div by Zero
+    Pairs inside the previous row or between the left and the previous row
+    are read from the neighbours' masks, the rest from our own.
 */
 void ConnectionTestRegion::connectAdjacentComponents()
 {
-    const float strokeWidths[] = {left, topLeft, top, topRight};
+    const bool similar[] = {
+        (leftSimilarity & Constants::similarToTop) != 0,
+        (leftSimilarity & Constants::similarToTopRight) != 0,
+        (similarity & Constants::leftSimilarToTopRight) != 0,
+        (topSimilarity & Constants::similarToLeft) != 0,
+        (similarity & Constants::topLeftSimilarToTopRight) != 0,
+        (topRightSimilarity & Constants::similarToLeft) != 0
+    };
     Component* components[] = {leftComponent, topLeftComponent, topComponent, topRightComponent};
+    int pair = 0;
     for(int i=0; i != sizeof(components)/sizeof(Component*); ++i) {
-        for(int j=i+1; j != sizeof(components)/sizeof(Component*); ++j) {
-            // being aware of nullComponents
-            if(components[i]&&components[j]&&!components[i]->isConnectedWith(*components[j])) {
-                const float ratio = strokeWidths[i]>strokeWidths[j] ? strokeWidths[i]/strokeWidths[j] : strokeWidths[j]/strokeWidths[i];
-                if(ratio < Component::groupingThreshold) {
-                    components[i]->connectWith(*components[j]);
-                }
+        for(int j=i+1; j != sizeof(components)/sizeof(Component*); ++j, ++pair) {
+            // similar neighbours are never background, so their components exist
+            if(similar[pair] && !components[i]->isConnectedWith(*components[j])) {
+                components[i]->connectWith(*components[j]);
             }
         }
     }
 }
 
 /*
-    Achtung: div by Zero
+    Joins the neighbour with the most similar stroke width, on ties the
+    last one in the order left, top left, top, top right. Ratios a/b and
+    c/d are compared as a*d and c*b, the stroke widths are only read if
+    more than one neighbour is similar.
 */
 Component* ConnectionTestRegion::calculateComponent()
 {
     if(current == Constants::strokeBackground)
         return Constants::nullComponent;
-    const float leftRatio = left>current ? left/current : current/left;
-    const float topLeftRatio = topLeft>current ? topLeft/current : current/topLeft;
-    const float topRatio = top>current ? top/current : current/top;
-    const float topRightRatio = topRight>current ? topRight/current : current/topRight;
-    const float ratios[] = {leftRatio, topLeftRatio, topRatio, topRightRatio};
-    const float minimumRatio = *std::min_element(ratios, ratios+4);
-    if(minimumRatio < Component::groupingThreshold) {
-        Component* calculatedComponent = NULL;
-        if(minimumRatio == leftRatio)
-            calculatedComponent = leftComponent;
-        if(minimumRatio == topLeftRatio)
-            calculatedComponent = topLeftComponent;
-        if(minimumRatio == topRatio)
-            calculatedComponent = topComponent;
-        if(minimumRatio == topRightRatio)
-            calculatedComponent = topRightComponent;
-        assert(calculatedComponent != NULL);// "minimumRatio should still be contained in ratios."
+    const uchar similarNeighbours = similarity & Constants::similarToNeighbours;
+    if(similarNeighbours == 0)
+        return new Component(*this);
+    Component* const components[] = {leftComponent, topLeftComponent, topComponent, topRightComponent};
+    Component* calculatedComponent = NULL;
+    if((similarNeighbours & (similarNeighbours - 1)) == 0) {
+        for(int i=0; calculatedComponent == NULL; ++i) {
+            if(similarNeighbours & (1 << i))
+                calculatedComponent = components[i];
+        }
+        calculatedComponent->addPixel(*this);
+        return calculatedComponent;
+    }
+    const int offsetsX[] = {-1, -1, 0, 1};
+    int bestLarger = 1, bestSmaller = 0;
+    for(int i=0; i != sizeof(components)/sizeof(Component*); ++i) {
+        if(!(similarNeighbours & (1 << i)))
+            continue;
+        const StrokeValue strokeWidth = Pictures::strokes(i == 0 ? y : y-1, x + offsetsX[i]);
+        const int larger = std::max(current, strokeWidth);
+        const int smaller = std::min(current, strokeWidth);
+        if(calculatedComponent == NULL || larger * bestSmaller <= bestLarger * smaller) {
+            calculatedComponent = components[i];
+            bestLarger = larger;
+            bestSmaller = smaller;
+        }
+    }
+    if(calculatedComponent != NULL) {
         calculatedComponent->addPixel(*this);
         return calculatedComponent;
     }
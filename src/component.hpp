@@ -1,21 +1,51 @@
+#ifndef OCTOSHARK_COMPONENT_HPP
+#define OCTOSHARK_COMPONENT_HPP
+
 #include <list>
 #include <set>
 #include <vector>
 #include "candidate.hpp"
+#include "config.hpp"
+#include "pictures.hpp"
 
 class ConnectionTestRegion;
 
+/*
+    The stroke pixels of a stroke map as runs of consecutive pixels,
+    sorted by row and column. The runs of row y are runs[rowStarts[y]]
+    up to runs[rowStarts[y+1]], their widths lie in values from offset
+    on. Everything but rowStarts grows with the stroke area only.
+*/
+class StrokeRuns {
+public:
+    struct Run {
+        int x;
+        int length;
+        int offset;
+    };
+    int rows, cols;
+    std::vector<int> rowStarts;
+    std::vector<Run> runs;
+    std::vector<StrokeValue> values;
+    double allocatedBytes() const;
+    StrokeRuns(const cv::Mat_<StrokeValue>& strokes);
+};
+
 class Component {
     friend class ConnectionTestRegion;
     
-    static std::vector<std::vector<Component*> > map;
-    static std::list<Component*> list;
-    static float groupingThreshold;
+    static thread_local std::vector<std::vector<Component*> > map;
+    static thread_local std::list<Component*> list;
+    static thread_local int groupingThresholdNumerator;
+    static thread_local int groupingThresholdDenominator;
 
     std::vector<Component*>* equivalenceClass;
     double strokeWidthSum;
     int minX, maxX, minY, maxY, pixelCount;
     void updateBounds(const int x, const int y);
+    static void setGroupingThreshold(const float threshold);
+    static void markSimilarPairs(const StrokeValue* a, const StrokeValue* b, const int count, uchar* masks, const uchar bit);
+    static std::list<Component*> findAllInRuns(const StrokeRuns& runs);
     
 public:
     const double getStrokeWidthSum() { return strokeWidthSum; };
@@ -25,13 +55,17 @@ public:
     const int getMaxY() { return maxY; };
     const int getPixelCount() { return pixelCount; };
     const std::vector<Component*>* getEquivalenceClass() const { return equivalenceClass; };
-    std::list<float> strokeWidths;
+    std::list<StrokeValue> strokeWidths;
     std::list<cv::Point> coordinates;
     static const std::vector<std::vector<Component*> > getMap() { return map; };
     
-    static std::list<Component*> findAll();
+    static bool haveSimilarStrokeWidths(const StrokeValue a, const StrokeValue b);
+    static cv::Mat_<uchar> computeSimilarities(const cv::Mat_<StrokeValue>& strokes);
+    static std::list<Component*> findAll(const Config::Parameters&);
     static std::set<const std::vector<Component*>*> collectEquivalenceClasses(const std::list<Component*>&);
-    static std::vector<LetterCandidate*> identifyLetterCandidates(const std::set<const std::vector<Component*>*>&);
+    static std::vector<LetterCandidate*> identifyLetterCandidates(const std::set<const std::vector<Component*>*>&, const Config::Parameters&);
+    static void release(const std::list<Component*>&, const std::set<const std::vector<Component*>*>&);
+    static double allocatedBytes(const std::list<Component*>&);
     Component(const ConnectionTestRegion&);
     
     void addPixel(const ConnectionTestRegion&);
@@ -43,9 +77,13 @@ class ConnectionTestRegion {
     Component * const leftComponent, * const topLeftComponent, * const topComponent, * const topRightComponent;
 public:
     const int x, y;
-    const float current, left, topLeft, top, topRight;
-    ConnectionTestRegion(const int x, const int y);
+    const StrokeValue current;
+    const uchar similarity, leftSimilarity, topSimilarity, topRightSimilarity;
+    ConnectionTestRegion(const int x, const int y, const cv::Mat_<uchar>& similarities);
+    ConnectionTestRegion(const int x, const int y, const StrokeValue current, const StrokeValue* neighbours, Component* const* components);
     
     void connectAdjacentComponents();
     Component* calculateComponent();
 };
+
+#endif
@@ -1,43 +1,434 @@
 #include <cstdlib>
 #include "config.hpp"
+#include "pictures.hpp"
 #include <fstream>
+#include <iostream>
+#include <sstream>
 
 namespace Config {
+    std::vector<std::string> inputFileNames;
     std::string inputFileName;
     std::string outputFileName;
-    std::map<std::string, int> variables;
+    std::string socketFileName;
+    std::string profileFileName;
+    std::string traceFileName;
+    std::string outputDirectory;
+    std::string cacheDirectory;
+    std::string manifestFileName;
+    std::string corpusPrefix;
+    int shardIndex = 0;
+    int shardCount = 1;
+    Parameters parameters;
+    std::vector<Grouping> groupings;
+}
+
+#ifndef SHEARING_ANGLES
+#define SHEARING_ANGLES 0
+#endif
+
+// the line variants of the build are the default sector
+#if defined(LINES_WITH_PROXIMITY_GRAPH)
+#define LINE_SECTOR Config::graphSector
+#elif defined(HORIZONTAL_LINES_WITH_FRUSTUM)
+#define LINE_SECTOR Config::frustumSector
+#elif defined(HORIZONTAL_LINES_WITH_CONE)
+#define LINE_SECTOR Config::coneSector
+#else
+#define LINE_SECTOR Config::xySector
+#endif
+#ifdef HORIZONTAL_LINES_WITH_CONE
+#define LINE_SECTOR_CONE HORIZONTAL_LINES_WITH_CONE
+#else
+#define LINE_SECTOR_CONE 3
+#endif
+
+namespace Constants {
+    const int defaultShearingAngles[] = {SHEARING_ANGLES};
+    const Config::LineSector defaultLineSector = LINE_SECTOR;
+    const int defaultLineSectorCone = LINE_SECTOR_CONE;
+}
+
+Config::Parameters::Parameters() :
+    accurateCanny(true),
+    decodeGrayscale(false),
+    apertureSize(5),
+    cannyThreshold1(1000),
+    cannyThreshold2(2000),
+    contourSizeLimit(10),
+    shearingAngles(Constants::defaultShearingAngles, Constants::defaultShearingAngles + sizeof(Constants::defaultShearingAngles)/sizeof(int)),
+    maxStrokeWidth(128),
+    autoStrokeWidthPercentile(0),
+    autoStrokeWidthFactor(2),
+    maxStrokeAngle(45),
+    adaptiveShearing(false),
+    adaptiveShearingFactor(1.5),
+    rayDensity(1),
+    textPolarity(Config::bothPolarities),
+    polarityMargin(2),
+    textureTileSize(0),
+    textureEdgeDensity(0.25),
+    textureOrientationEntropy(0.9),
+    textureSpacingVariation(0.8),
+    groupingThreshold(1.66667),
+    sparseStrokeShare(0.1),
+    maxStrokeVariance(2),
+    minLetterHeight(8),
+    maxStrokeWidthRatio(2),
+    maxHeightRatio(2),
+    maxColorDifference(250),
+    maxLetterDistXByStrokeWidth(5),
+    maxLetterDistYByStrokeWidth(5),
+    letterCandidateConnectionXWeight(3),
+    letterCandidateConnectionYWeight(7),
+    maxAzimuthDifference(0.392699),
+    minLineSize(2),
+    lineSector(Constants::defaultLineSector),
+    lineSectorCone(Constants::defaultLineSectorCone),
+    extractionCompression(3),
+    extractionQuality(95),
+    extractionQueueSize(64),
+    extractionThreads(2),
+    pipelineDecodeThreads(1),
+    pipelineRayThreads(1),
+    pipelineGroupingThreads(1),
+    pipelineQueueSize(2),
+    memoryBudget(0),
+    serverMaxInFlight(16),
+    serverMaxRequestSize(268435456),
+    serverThreads(0)
+    {}
+
+inline double parseNumber(const std::string& key, const std::string& value)
+{
+    const char* const begin = value.c_str();
+    char* end;
+    const double number = std::strtod(begin, &end);
+    if(end == begin || *end != '\0') {
+        std::cerr<<"config.ini: "<<key<<'='<<value<<std::endl;
+        throw "config.ini contains a malformed number.";
+    }
+    return number;
+}
+
+/*
+    Bytes with an optional K, M or G suffix.
+*/
+inline double parseBytes(const std::string& key, const std::string& value)
+{
+    const std::string suffixes = "KMG";
+    const size_t suffix = value.empty() ? std::string::npos : suffixes.find(value[value.size() - 1]);
+    if(suffix == std::string::npos)
+        return parseNumber(key, value);
+    return parseNumber(key, value.substr(0, value.size() - 1)) * (1L << (10 * (suffix + 1)));
+}
+
+inline std::vector<int> parseList(const std::string& key, const std::string& value)
+{
+    std::vector<int> numbers;
+    std::stringstream stream(value);
+    std::string number;
+    while(std::getline(stream, number, ',')) {
+        if(!number.empty())
+            numbers.push_back(parseNumber(key, number));
+    }
+    return numbers;
+}
+
+void Config::Parameters::set(const std::string& key, const std::string& value)
+{
+    if(key == "shearingAngles") {
+        shearingAngles = parseList(key, value);
+        return;
+    }
+    if(key == "memoryBudget") {
+        memoryBudget = parseBytes(key, value);
+        return;
+    }
+    if(key == "textPolarity") {
+        if(value == "both") textPolarity = Config::bothPolarities;
+        else if(value == "dark") textPolarity = Config::darkText;
+        else if(value == "light") textPolarity = Config::lightText;
+        else if(value == "auto") textPolarity = Config::autoPolarity;
+        else throw "textPolarity has to be both, dark, light or auto.";
+        return;
+    }
+    if(key == "lineSector") {
+        if(value == "xy") lineSector = Config::xySector;
+        else if(value == "frustum") lineSector = Config::frustumSector;
+        else if(value == "cone") lineSector = Config::coneSector;
+        else if(value == "graph") lineSector = Config::graphSector;
+        else throw "lineSector has to be xy, frustum, cone or graph.";
+        return;
+    }
+    const double number = parseNumber(key, value);
+    if(key == "accurateCanny") accurateCanny = number != 0;
+    else if(key == "decodeGrayscale") decodeGrayscale = number != 0;
+    else if(key == "apertureSize") apertureSize = number;
+    else if(key == "cannyThreshold1") cannyThreshold1 = number;
+    else if(key == "cannyThreshold2") cannyThreshold2 = number;
+    else if(key == "contourSizeLimit") contourSizeLimit = number;
+    else if(key == "maxStrokeWidth") maxStrokeWidth = number;
+    else if(key == "autoStrokeWidthPercentile") autoStrokeWidthPercentile = number;
+    else if(key == "autoStrokeWidthFactor") autoStrokeWidthFactor = number;
+    else if(key == "maxStrokeAngle") maxStrokeAngle = number;
+    else if(key == "adaptiveShearing") adaptiveShearing = number != 0;
+    else if(key == "adaptiveShearingFactor") adaptiveShearingFactor = number;
+    else if(key == "rayDensity") rayDensity = number;
+    else if(key == "polarityMargin") polarityMargin = number;
+    else if(key == "textureTileSize") textureTileSize = number;
+    else if(key == "textureEdgeDensity") textureEdgeDensity = number;
+    else if(key == "textureOrientationEntropy") textureOrientationEntropy = number;
+    else if(key == "textureSpacingVariation") textureSpacingVariation = number;
+    else if(key == "groupingThreshold") groupingThreshold = number;
+    else if(key == "sparseStrokeShare") sparseStrokeShare = number;
+    else if(key == "maxStrokeVariance") maxStrokeVariance = number;
+    else if(key == "minLetterHeight") minLetterHeight = number;
+    else if(key == "maxStrokeWidthRatio") maxStrokeWidthRatio = number;
+    else if(key == "maxHeightRatio") maxHeightRatio = number;
+    else if(key == "maxColorDifference") maxColorDifference = number;
+    else if(key == "maxLetterDistXByStrokeWidth") maxLetterDistXByStrokeWidth = number;
+    else if(key == "maxLetterDistYByStrokeWidth") maxLetterDistYByStrokeWidth = number;
+    else if(key == "letterCandidateConnectionXWeight") letterCandidateConnectionXWeight = number;
+    else if(key == "letterCandidateConnectionYWeight") letterCandidateConnectionYWeight = number;
+    else if(key == "maxAzimuthDifference") maxAzimuthDifference = number;
+    else if(key == "minLineSize") minLineSize = number;
+    else if(key == "lineSectorCone") lineSectorCone = number;
+    else if(key == "extractionCompression") extractionCompression = number;
+    else if(key == "extractionQuality") extractionQuality = number;
+    else if(key == "extractionQueueSize") extractionQueueSize = number;
+    else if(key == "extractionThreads") extractionThreads = number;
+    else if(key == "pipelineDecodeThreads") pipelineDecodeThreads = number;
+    else if(key == "pipelineRayThreads") pipelineRayThreads = number;
+    else if(key == "pipelineGroupingThreads") pipelineGroupingThreads = number;
+    else if(key == "pipelineQueueSize") pipelineQueueSize = number;
+    else if(key == "serverMaxInFlight") serverMaxInFlight = number;
+    else if(key == "serverMaxRequestSize") serverMaxRequestSize = number;
+    else if(key == "serverThreads") serverThreads = number;
+    else {
+        std::cerr<<"config.ini: "<<key<<std::endl;
+        throw "config.ini contains an unknown key.";
+    }
+}
+
+bool Config::Parameters::isGroupingKey(const std::string& key)
+{
+    const char* const groupingKeys[] = {
+        "maxStrokeWidthRatio", "maxHeightRatio", "maxColorDifference",
+        "maxLetterDistXByStrokeWidth", "maxLetterDistYByStrokeWidth",
+        "letterCandidateConnectionXWeight", "letterCandidateConnectionYWeight",
+        "maxAzimuthDifference", "minLineSize", "lineSector", "lineSectorCone"
+    };
+    for(size_t i = 0; i != sizeof(groupingKeys)/sizeof(const char*); ++i) {
+        if(key == groupingKeys[i])
+            return true;
+    }
+    return false;
+}
+
+void Config::Parameters::validate() const
+{
+    if(apertureSize != 3 && apertureSize != 5 && apertureSize != 7)
+        throw "apertureSize has to be 3, 5 or 7.";
+    if(shearingAngles.empty())
+        throw "shearingAngles needs at least one angle.";
+    if(maxStrokeWidth < 1 || maxStrokeWidth >= Constants::strokeBackground)
+        throw "maxStrokeWidth is out of range, build with WIDE_STROKES for wide strokes.";
+    if(autoStrokeWidthPercentile < 0 || autoStrokeWidthPercentile >= 1 || autoStrokeWidthFactor < 1)
+        throw "autoStrokeWidthPercentile has to be in [0, 1), autoStrokeWidthFactor at least 1.";
+    if(contourSizeLimit < 1)
+        throw "contourSizeLimit has to be positive.";
+    if(groupingThreshold <= 1 || maxStrokeWidthRatio <= 1 || maxHeightRatio <= 1)
+        throw "Ratio thresholds have to be larger than 1.";
+    if(adaptiveShearingFactor < 1)
+        throw "adaptiveShearingFactor must not be smaller than 1.";
+    if(sparseStrokeShare < 0 || sparseStrokeShare > 1)
+        throw "sparseStrokeShare has to be in [0, 1].";
+    if(rayDensity <= 0 || rayDensity > 1)
+        throw "rayDensity has to be in (0, 1].";
+    if(polarityMargin < 1)
+        throw "polarityMargin has to be at least 1.";
+    if(textureTileSize < 0 || textureEdgeDensity < 0 || textureOrientationEntropy < 0 || textureOrientationEntropy > 1 || textureSpacingVariation < 0)
+        throw "Texture thresholds are out of range.";
+    if(maxStrokeAngle < 0 || maxStrokeAngle > 90 || maxAzimuthDifference < 0)
+        throw "Angle thresholds are out of range.";
+    if(pipelineDecodeThreads < 1 || pipelineRayThreads < 1 || pipelineGroupingThreads < 1 || pipelineQueueSize < 1)
+        throw "Every pipeline stage needs at least one thread and queue slot.";
+    if(memoryBudget < 0)
+        throw "memoryBudget must not be negative.";
+    if(extractionQuality < 0 || extractionQuality > 100)
+        throw "extractionQuality has to be in [0, 100].";
+}
+
+
+/*
+    "i/n" selects every n-th image starting with the i-th, counting from 0.
+*/
+inline void parseShard(const std::string& value)
+{
+    std::stringstream stream(value);
+    char separator = 0;
+    int index, count;
+    if(!(stream>>index>>separator>>count) || separator != '/' || !stream.eof() || count < 1 || index < 0 || index >= count)
+        throw "--shard expects i/n with 0 <= i < n.";
+    Config::shardIndex = index;
+    Config::shardCount = count;
 }
 
 void Config::initialize(const int argc, const char** argv)
 {
     Config::readConfigFile();
-    if(argc != 2)
-        throw "Wrong parameter count. Please supply a filename.";
-    Config::inputFileName = argv[1];
+    for(int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if(argument == "--serve" || argument == "--profile" || argument == "--trace" || argument == "--output" || argument == "--memory-budget" || argument == "--cache" || argument == "--grouping"
+                || argument == "--manifest" || argument == "--shard" || argument == "--corpus") {
+            if(i + 1 == argc)
+                throw "Missing value for option.";
+            const std::string value = argv[++i];
+            if(argument == "--serve")
+                Config::socketFileName = value;
+            else if(argument == "--profile")
+                Config::profileFileName = value;
+            else if(argument == "--output")
+                Config::outputDirectory = value;
+            else if(argument == "--grouping")
+                Config::addGrouping(value);
+            else if(argument == "--cache")
+                Config::cacheDirectory = value;
+            else if(argument == "--manifest")
+                Config::readManifest(value);
+            else if(argument == "--shard")
+                parseShard(value);
+            else if(argument == "--corpus")
+                Config::corpusPrefix = value;
+            else if(argument == "--memory-budget")
+                Config::parameters.memoryBudget = parseBytes(argument, value);
+            else
+                Config::traceFileName = value;
+        } else {
+            Config::inputFileNames.push_back(argument);
+        }
+    }
+    Config::parameters.validate();
+    // the configuration of config.ini comes first and writes unnamed results
+    Config::groupings.insert(Config::groupings.begin(), Grouping());
+    Config::groupings.front().parameters = Config::parameters;
+    if(!Config::socketFileName.empty())
+        return;
+    if(Config::shardCount > 1) {
+        std::vector<std::string> shard;
+        for(size_t i = Config::shardIndex; i < Config::inputFileNames.size(); i += Config::shardCount) {
+            shard.push_back(Config::inputFileNames[i]);
+        }
+        Config::inputFileNames.swap(shard);
+        if(!Config::corpusPrefix.empty()) {
+            std::stringstream suffix;
+            suffix<<".shard"<<Config::shardIndex<<"of"<<Config::shardCount;
+            Config::corpusPrefix.append(suffix.str());
+        }
+    }
+    // a shard of a manifest may be empty
+    if(Config::inputFileNames.empty() && !Config::manifestFileName.empty())
+        return;
+    if(Config::inputFileNames.empty())
+        throw "Wrong parameter count. Please supply at least one filename.";
+    Config::selectInputFile(Config::inputFileNames.front());
+}
+
+void Config::selectInputFile(const std::string& fileName)
+{
+    Config::inputFileName = fileName;
+    Config::outputFileName = Config::outputFileNameFor(fileName);
+}
+
+/*
+    Results of a named grouping configuration get its name before the
+    extension, e.g. image.cone30.txt.
+*/
+std::string Config::outputFileNameFor(const std::string& fileName, const std::string& groupingName)
+{
+    std::string outputFileName;
 #ifdef TEXT_OUTPUT    
-    const size_t fileExtensionIndex = Config::inputFileName.rfind('.');
+    const std::string extension = groupingName.empty() ? std::string(".txt") : "." + groupingName + ".txt";
+    if(!Config::outputDirectory.empty()) {
+        const size_t directoryIndex = fileName.find_last_of('/');
+        const std::string baseName = directoryIndex == std::string::npos ? fileName : fileName.substr(directoryIndex + 1);
+        outputFileName = Config::outputDirectory;
+        outputFileName.append("/").append(baseName.substr(0, baseName.rfind('.'))).append(extension);
+        return outputFileName;
+    }
+    const size_t fileExtensionIndex = fileName.rfind('.');
     if(fileExtensionIndex != std::string::npos) {
-        Config::outputFileName = TEXT_OUTPUT;
-        Config::outputFileName.append(Config::inputFileName.begin(), Config::inputFileName.begin()+fileExtensionIndex);
-        Config::outputFileName.append(".txt");
+        outputFileName = TEXT_OUTPUT;
+        outputFileName.append(fileName.begin(), fileName.begin()+fileExtensionIndex);
+        outputFileName.append(extension);
     } else {
-        Config::outputFileName = std::string(argv[1]).append(".txt");
+        outputFileName = std::string(fileName).append(extension);
     }
 #endif
+    return outputFileName;
+}
+
+/*
+    One image file name per line, empty lines are skipped.
+*/
+void Config::readManifest(const std::string& fileName)
+{
+    std::ifstream manifest(fileName.c_str());
+    if(!manifest.is_open()) {
+        std::cerr<<fileName<<std::endl;
+        throw "Manifest could not be opened.";
+    }
+    Config::manifestFileName = fileName;
+    std::string line;
+    while(std::getline(manifest, line)) {
+        if(!line.empty())
+            Config::inputFileNames.push_back(line);
+    }
 }
 
 void Config::readConfigFile()
+{
+    Parameters readParameters;
+    Config::readParameters("config.ini", readParameters, false);
+    Config::parameters = readParameters;
+}
+
+/*
+    Reads key=value lines over the given parameters. Grouping
+    configurations may only change the line grouping.
+*/
+void Config::readParameters(const std::string& fileName, Parameters& parameters, const bool onlyGrouping)
 {
     std::string line;
-    std::fstream configStream("config.ini", std::fstream::in);
-    if(!configStream.is_open())
-        throw "config.ini could not be opened.";
-    while(!configStream.eof()) {
-        getline(configStream, line);
-        Config::variables.insert(std::make_pair(
-            line.substr(0, line.find('=')),
-            std::atoi(line.substr(line.find('=') + 1, line.length()).c_str())
-        ));
+    std::fstream configStream(fileName.c_str(), std::fstream::in);
+    if(!configStream.is_open()) {
+        std::cerr<<fileName<<std::endl;
+        throw "Config file could not be opened.";
+    }
+    while(getline(configStream, line)) {
+        if(line.empty() || line[0] == '#')
+            continue;
+        const size_t separator = line.find('=');
+        if(separator == std::string::npos)
+            throw "Config file contains a line without '='.";
+        const std::string key = line.substr(0, separator);
+        if(onlyGrouping && !Parameters::isGroupingKey(key)) {
+            std::cerr<<fileName<<": "<<key<<std::endl;
+            throw "Grouping configurations may only set line grouping parameters.";
+        }
+        parameters.set(key, line.substr(separator + 1));
     }
     configStream.close();
+    parameters.validate();
+}
+
+void Config::addGrouping(const std::string& fileName)
+{
+    Grouping grouping;
+    const size_t directoryIndex = fileName.find_last_of('/');
+    const std::string baseName = directoryIndex == std::string::npos ? fileName : fileName.substr(directoryIndex + 1);
+    grouping.name = baseName.substr(0, baseName.rfind('.'));
+    grouping.parameters = Config::parameters;
+    Config::readParameters(fileName, grouping.parameters, true);
+    Config::groupings.push_back(grouping);
 }
@@ -1,11 +1,103 @@
-#include <map>
+#ifndef OCTOSHARK_CONFIG_HPP
+#define OCTOSHARK_CONFIG_HPP
+
 #include <string>
+#include <vector>
 
 namespace Config {
+    enum LineSector { xySector, frustumSector, coneSector, graphSector };
+    enum TextPolarity { bothPolarities, darkText, lightText, autoPolarity };
+
+    /*
+        Every tunable of the pipeline, typed and validated once when
+        config.ini is read. Keys missing from the file keep these defaults,
+        unknown keys and malformed values are errors.
+    */
+    struct Parameters {
+        bool accurateCanny;
+        bool decodeGrayscale;
+        int apertureSize;
+        double cannyThreshold1;
+        double cannyThreshold2;
+        int contourSizeLimit;
+        std::vector<int> shearingAngles;
+        int maxStrokeWidth;
+        float autoStrokeWidthPercentile;
+        float autoStrokeWidthFactor;
+        float maxStrokeAngle;
+        bool adaptiveShearing;
+        float adaptiveShearingFactor;
+        float rayDensity;
+        TextPolarity textPolarity;
+        float polarityMargin;
+        int textureTileSize;
+        float textureEdgeDensity;
+        float textureOrientationEntropy;
+        float textureSpacingVariation;
+        float groupingThreshold;
+        float sparseStrokeShare;
+        double maxStrokeVariance;
+        int minLetterHeight;
+        float maxStrokeWidthRatio;
+        float maxHeightRatio;
+        int maxColorDifference;
+        float maxLetterDistXByStrokeWidth;
+        float maxLetterDistYByStrokeWidth;
+        int letterCandidateConnectionXWeight;
+        int letterCandidateConnectionYWeight;
+        double maxAzimuthDifference;
+        unsigned int minLineSize;
+        LineSector lineSector;
+        int lineSectorCone;
+        int extractionCompression;
+        int extractionQuality;
+        int extractionQueueSize;
+        int extractionThreads;
+        int pipelineDecodeThreads;
+        int pipelineRayThreads;
+        int pipelineGroupingThreads;
+        int pipelineQueueSize;
+        double memoryBudget;
+        int serverMaxInFlight;
+        int serverMaxRequestSize;
+        int serverThreads;
+        void set(const std::string& key, const std::string& value);
+        void validate() const;
+        static bool isGroupingKey(const std::string& key);
+        Parameters();
+    };
+
+    /*
+        One of several line grouping configurations evaluated on the same
+        letter candidates, named after its file.
+    */
+    struct Grouping {
+        std::string name;
+        Parameters parameters;
+    };
+
     void initialize(const int, const char**);
     void readConfigFile();
+    void readParameters(const std::string& fileName, Parameters& parameters, const bool onlyGrouping);
+    void addGrouping(const std::string& fileName);
+    void readManifest(const std::string& fileName);
+    void selectInputFile(const std::string&);
+    std::string outputFileNameFor(const std::string&, const std::string& groupingName = "");
     
+    extern std::vector<std::string> inputFileNames;
     extern std::string inputFileName;
     extern std::string outputFileName;
-    extern std::map<std::string, int> variables;
+    extern std::string socketFileName;
+    extern std::string profileFileName;
+    extern std::string traceFileName;
+    extern std::string outputDirectory;
+    extern std::string cacheDirectory;
+    extern std::string manifestFileName;
+    extern std::string corpusPrefix;
+    extern int shardIndex;
+    extern int shardCount;
+    extern Parameters parameters;
+    extern std::vector<Grouping> groupings;
 }
+
+#endif
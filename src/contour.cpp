@@ -1,15 +1,12 @@
 #include "contour.hpp"
+#include "profiler.hpp"
+#include <set>
 #include <iostream>
 
-namespace Constants {
-    const unsigned int contourSizeLimit = 10;
-}
-
 Contour::Contour(const cv::Rect& firstElement) :
     wasDrawn(false)
 {
     this->subContours = std::vector<cv::Rect>();
-    this->subContours.reserve(Constants::contourSizeLimit);
     this->subContours.push_back(firstElement);
     this->size = firstElement.width * firstElement.height;
 }
@@ -93,9 +90,9 @@ bool Contour::operator<(const Contour& other) const
     return this->minX() < other.minX();
 }
 
-bool Contour::mergeWith(const Contour& other)
+bool Contour::mergeWith(const Contour& other, const unsigned int sizeLimit)
 {
-    if(this->subContours.size() + other.subContours.size() > Constants::contourSizeLimit) {
+    if(this->subContours.size() + other.subContours.size() > sizeLimit) {
         return false;
     }
     this->subContours.insert(this->subContours.end(), other.subContours.begin(), other.subContours.end());
@@ -145,7 +142,7 @@ std::vector<Contour*> Contour::collectContours(const cv::Mat_<uchar>& cannyImage
     return result;
 }
 
-void Contour::mergeOverlappingContours(std::vector<Contour*>& contours)
+void Contour::mergeOverlappingContours(std::vector<Contour*>& contours, const unsigned int sizeLimit)
 {    
     std::sort(contours.begin(), contours.end());
     for(std::vector<Contour*>::iterator i = contours.begin(); i != contours.end(); ++i) {
@@ -154,7 +151,7 @@ void Contour::mergeOverlappingContours(std::vector<Contour*>& contours)
         for(const int iMaxX = (*i)->maxX(); j != contours.end() && (*j)->minX() <= iMaxX; ++j) {
             if(*i==*j) continue;
             if((*i)->intersects(**j) && (!(*i)->includes(**j)) && (!(*j)->includes(**i))) {
-                if((*i)->mergeWith(**j)) {
+                if((*i)->mergeWith(**j, sizeLimit)) {
                     //delete *j;
                     *j = *i;   
                 }
@@ -163,14 +160,22 @@ void Contour::mergeOverlappingContours(std::vector<Contour*>& contours)
     }
 }
 
-const std::vector<std::vector<Contour*> > Contour::buildLimitMap(const cv::Mat_<uchar>& cannyImage)
+/*
+    Merging leaves several entries pointing to the same contour, so every
+    contour allocated on the way is handed out in allocatedContours for
+    the caller to delete once the limit map is no longer needed.
+*/
+const std::vector<std::vector<Contour*> > Contour::buildLimitMap(const cv::Mat_<uchar>& cannyImage, std::vector<Contour*>& allocatedContours, const Config::Parameters& parameters)
 {
     std::vector<std::vector<Contour*> > result(cannyImage.rows, std::vector<Contour*>(cannyImage.cols, (Contour*)NULL));
 #ifdef NO_CONTOURS
     return result;
 #endif
     std::vector<Contour*> contours = Contour::collectContours(cannyImage);
-    Contour::mergeOverlappingContours(contours);
+    allocatedContours.insert(allocatedContours.end(), contours.begin(), contours.end());
+    Contour::mergeOverlappingContours(contours, parameters.contourSizeLimit);
+    Profiler::count("contoursBeforeMerging", contours.size());
+    Profiler::count("contoursAfterMerging", std::set<Contour*>(contours.begin(), contours.end()).size());
     for(std::vector<Contour*>::iterator i = contours.begin(); i != contours.end(); ++i) {
         if(!(*i)->wasDrawn) {
             (*i)->insertIntoLimitMap(result);
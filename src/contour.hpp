@@ -1,11 +1,15 @@
+#ifndef OCTOSHARK_CONTOUR_HPP
+#define OCTOSHARK_CONTOUR_HPP
+
 #include <vector>
 #include <opencv/cv.h>
+#include "config.hpp"
 
 class Contour {
     bool wasDrawn;
     int size;
     std::vector<cv::Rect> subContours;
-    bool mergeWith(const Contour& other);
+    bool mergeWith(const Contour& other, const unsigned int sizeLimit);
     int minX() const;
     int maxX() const;
     bool operator<(const Contour& other) const;
@@ -20,7 +24,9 @@ public:
     void insertIntoLimitMap(std::vector<std::vector<Contour*> >& limitMap);
     
     Contour(const cv::Rect& firstElement);
-    static const std::vector<std::vector<Contour*> > buildLimitMap(const cv::Mat_<uchar>& cannyImage);
+    static const std::vector<std::vector<Contour*> > buildLimitMap(const cv::Mat_<uchar>& cannyImage, std::vector<Contour*>& allocatedContours, const Config::Parameters& parameters);
     static std::vector<Contour*> collectContours(const cv::Mat_<uchar>& cannyImage);
-    static void mergeOverlappingContours(std::vector<Contour*>& contours);
-};
\ No newline at end of file
+    static void mergeOverlappingContours(std::vector<Contour*>& contours, const unsigned int sizeLimit);
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "corpus.hpp"
+#include "profiler.hpp"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <unistd.h>
+
+std::string resultsFileName(const std::string& prefix, const Config::Grouping& grouping)
+{
+    return grouping.name.empty() ? prefix + ".txt" : prefix + "." + grouping.name + ".txt";
+}
+
+CorpusWriter::CorpusWriter(const std::string& prefix, const std::vector<Config::Grouping>& groupings) :
+    groupings(groupings),
+    skipped(0),
+    written(0),
+    lines(0),
+    start(Profiler::now())
+{
+    const std::string checkpointFileName = prefix + ".done";
+    recover(prefix, checkpointFileName);
+    checkpoint.open(checkpointFileName.c_str(), std::ofstream::out | std::ofstream::app);
+    if(!checkpoint.is_open())
+        throw "Corpus checkpoint could not be opened.";
+    for(std::vector<Config::Grouping>::const_iterator i = groupings.begin(); i != groupings.end(); ++i) {
+        results.push_back(new std::ofstream(resultsFileName(prefix, *i).c_str(), std::ofstream::out | std::ofstream::app));
+        if(!results.back()->is_open())
+            throw "Corpus results could not be opened.";
+    }
+}
+
+CorpusWriter::~CorpusWriter()
+{
+    for(std::vector<std::ofstream*>::const_iterator i = results.begin(); i != results.end(); ++i) {
+        delete *i;
+    }
+}
+
+/*
+    Reads the complete lines of the checkpoint, "<image>\t<size>,<size>..."
+    with a size per result file, and truncates the checkpoint after the
+    last of them and the result files to its sizes. Files that don't
+    exist yet have size 0.
+*/
+void CorpusWriter::recover(const std::string& prefix, const std::string& checkpointFileName)
+{
+    sizes.assign(groupings.size(), 0);
+    std::string content;
+    {
+        std::ifstream completed(checkpointFileName.c_str(), std::ifstream::binary);
+        content.assign(std::istreambuf_iterator<char>(completed), std::istreambuf_iterator<char>());
+    }
+    size_t lineStart = 0, validEnd = 0;
+    for(size_t lineEnd = content.find('\n'); lineEnd != std::string::npos; lineEnd = content.find('\n', lineStart)) {
+        const std::string line = content.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+        const size_t tab = line.rfind('\t');
+        if(tab == std::string::npos)
+            continue;
+        std::vector<long long> lineSizes;
+        std::stringstream sizeList(line.substr(tab + 1));
+        std::string size;
+        while(std::getline(sizeList, size, ',')) {
+            lineSizes.push_back(std::atoll(size.c_str()));
+        }
+        if(lineSizes.size() != groupings.size())
+            throw "Corpus checkpoint does not match the groupings.";
+        done.insert(line.substr(0, tab));
+        sizes = lineSizes;
+        validEnd = lineStart;
+    }
+    if(validEnd != content.size() && truncate(checkpointFileName.c_str(), validEnd) != 0)
+        throw "Corpus checkpoint could not be truncated.";
+    for(size_t i = 0; i != groupings.size(); ++i) {
+        const std::string fileName = resultsFileName(prefix, groupings[i]);
+        if(truncate(fileName.c_str(), sizes[i]) != 0 && access(fileName.c_str(), F_OK) == 0)
+            throw "Corpus results could not be truncated.";
+    }
+}
+
+/*
+    The images of the list that are not in the checkpoint yet, in order.
+*/
+std::vector<std::string> CorpusWriter::pending(const std::vector<std::string>& fileNames)
+{
+    std::vector<std::string> pendingFileNames;
+    for(std::vector<std::string>::const_iterator i = fileNames.begin(); i != fileNames.end(); ++i) {
+        if(done.count(*i) == 0)
+            pendingFileNames.push_back(*i);
+    }
+    skipped = fileNames.size() - pendingFileNames.size();
+    return pendingFileNames;
+}
+
+/*
+    Blocks are flushed before the image goes into the checkpoint, so the
+    checkpoint never lists an image without its results, and its line
+    records where they end.
+*/
+void CorpusWriter::write(const std::string& fileName, const std::vector<std::vector<DetectedLine> >& detectedLines, const std::string& strategy)
+{
+    Profiler::Span span("corpusOutput");
+    std::vector<std::string> blocks;
+    for(std::vector<std::vector<DetectedLine> >::const_iterator grouping = detectedLines.begin(); grouping != detectedLines.end(); ++grouping) {
+        std::stringstream block;
+        block<<'#'<<fileName<<'\n';
+        if(!strategy.empty())
+            block<<'#'<<strategy<<'\n';
+        for(std::vector<DetectedLine>::const_iterator i = grouping->begin(); i != grouping->end(); ++i) {
+            block<<i->boundingRect.x<<','<<i->boundingRect.y<<','<<i->boundingRect.width<<','<<i->boundingRect.height<<'\n';
+        }
+        block<<'\n';
+        blocks.push_back(block.str());
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    for(size_t i = 0; i != blocks.size() && i != results.size(); ++i) {
+        *results[i]<<blocks[i];
+        results[i]->flush();
+        sizes[i] += blocks[i].size();
+    }
+    checkpoint<<fileName<<'\t';
+    for(size_t i = 0; i != sizes.size(); ++i) {
+        checkpoint<<(i == 0 ? "" : ",")<<sizes[i];
+    }
+    checkpoint<<'\n';
+    checkpoint.flush();
+    ++written;
+    if(!detectedLines.empty())
+        lines += detectedLines.front().size();
+}
+
+/*
+    Images that neither were done before nor got written failed, they are
+    retried by the next run.
+*/
+void CorpusWriter::report(std::ostream& stream, const size_t shardItems) const
+{
+    const double seconds = Profiler::now() - start;
+    stream<<"shard "<<Config::shardIndex<<'/'<<Config::shardCount<<": "
+        <<shardItems<<" images, "<<skipped<<" skipped, "<<written<<" written, "
+        <<shardItems - skipped - written<<" failed, "<<lines<<" lines in "
+        <<std::fixed<<std::setprecision(1)<<seconds<<" s, "
+        <<std::setprecision(2)<<(seconds > 0 ? written / seconds : 0)<<" images/s"<<std::endl;
+}
@@ -0,0 +1,45 @@
+#ifndef OCTOSHARK_CORPUS_HPP
+#define OCTOSHARK_CORPUS_HPP
+
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "config.hpp"
+#include "detection.hpp"
+
+/*
+    Results of a corpus run in a few append-only files instead of a text
+    file per image: <prefix>.txt and <prefix>.<grouping>.txt hold the
+    blocks of all images, each the content of its text file followed by
+    an empty line. <prefix>.done lists the images whose blocks are
+    complete, each with the sizes of the result files after its blocks.
+    A rerun with the same prefix skips them and first cuts every file
+    back to the sizes of the last complete line, so blocks of an image
+    that was being written when the run died, and a torn checkpoint line,
+    are gone before the image is detected again.
+*/
+class CorpusWriter {
+    const std::vector<Config::Grouping>& groupings;
+    std::vector<std::ofstream*> results;
+    std::ofstream checkpoint;
+    std::set<std::string> done;
+    std::vector<long long> sizes;
+    void recover(const std::string& prefix, const std::string& checkpointFileName);
+    std::mutex lock;
+    size_t skipped;
+    size_t written;
+    size_t lines;
+    double start;
+    CorpusWriter(const CorpusWriter&);
+    CorpusWriter& operator=(const CorpusWriter&);
+public:
+    std::vector<std::string> pending(const std::vector<std::string>& fileNames);
+    void write(const std::string& fileName, const std::vector<std::vector<DetectedLine> >& lines, const std::string& strategy);
+    void report(std::ostream& stream, const size_t shardItems) const;
+    CorpusWriter(const std::string& prefix, const std::vector<Config::Grouping>& groupings);
+    ~CorpusWriter();
+};
+
+#endif
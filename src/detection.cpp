@@ -0,0 +1,198 @@
+#include "detection.hpp"
+#include "pictures.hpp"
+#include "ray.hpp"
+#include "component.hpp"
+#include "candidate.hpp"
+#include "memory.hpp"
+#include "profiler.hpp"
+#include <thread>
+
+/*
+    Grouping of one configuration on its own copies of the letter
+    candidates, so configurations don't share neighbourhoods.
+*/
+struct GroupingRun {
+    std::vector<LetterCandidate*> letterCandidates;
+    const Config::Grouping* grouping;
+    std::vector<DetectedLine> lines;
+    double start;
+    double seconds;
+};
+
+void runGrouping(GroupingRun* run)
+{
+    run->start = Profiler::now();
+    const std::vector<LineCandidate*> lineCandidates = LetterCandidate::identifyLineCandidates(run->letterCandidates, run->grouping->parameters);
+    run->lines = Detection::linesOf(lineCandidates);
+    LetterCandidate::release(run->letterCandidates, lineCandidates);
+    run->seconds = Profiler::now() - run->start;
+}
+
+void Detection::run()
+{
+    castRays();
+    group();
+}
+
+void Detection::castRays()
+{
+    Memory::count("pictures", Memory::picturesBytes());
+    std::vector<std::vector<Contour*> > contourLimitMap;
+    {
+        Profiler::Span span("contours");
+        contourLimitMap = Contour::buildLimitMap(Pictures::canny, contours, parameters);
+        Memory::count("contours", (double) Pictures::canny.total() * sizeof(Contour*) + contours.size() * sizeof(Contour));
+#ifdef SHOW_PICTURES
+        std::set<Contour*> contoursSet;
+        for(std::vector<std::vector<Contour*> >::const_iterator i = contourLimitMap.begin(); i != contourLimitMap.end(); ++i) {
+            contoursSet.insert(i->begin(), i->end());
+        }
+        for(std::set<Contour*>::const_iterator i = contoursSet.begin(); i != contoursSet.end(); ++i) {
+            if(*i) {
+                (*i)->drawOn(Pictures::input, cv::Scalar(135,212,68), cv::Scalar(57,76,219));
+            }
+        }
+#endif
+    }
+    std::vector<EdgePixel> edges;
+    {
+        Profiler::Span span("collectEdges");
+        edges = EdgePixel::collect(contourLimitMap);
+    }
+    if(parameters.textureTileSize > 0) {
+        Profiler::Span span("dropTextureTiles");
+        EdgePixel::dropTextureTiles(edges, parameters);
+    }
+    Config::Parameters rayParameters = parameters;
+    if(parameters.autoStrokeWidthPercentile > 0) {
+        Profiler::Span span("estimateStrokeWidth");
+        rayParameters.maxStrokeWidth = Ray::estimateMaxStrokeWidth(edges, parameters);
+    }
+    int directions = Ray::bothDirections;
+    if(parameters.textPolarity == Config::darkText)
+        directions = Ray::againstGradient;
+    else if(parameters.textPolarity == Config::lightText)
+        directions = Ray::alongGradient;
+    else if(parameters.textPolarity == Config::autoPolarity) {
+        Profiler::Span span("estimatePolarity");
+        directions = Ray::estimatePolarity(edges, rayParameters);
+    }
+    if(parameters.textPolarity != Config::autoPolarity || directions != Ray::bothDirections) {
+        castRays(edges, directions, rayParameters);
+        return;
+    }
+    // mixed polarities get a stroke map each, so their strokes never touch
+    castRays(edges, Ray::alongGradient, rayParameters);
+    Pictures::darkStrokes = cv::Mat_<StrokeValue>(Pictures::strokes.size(), Constants::strokeBackground);
+    std::swap(Pictures::strokes, Pictures::darkStrokes);
+    castRays(edges, Ray::againstGradient, rayParameters);
+    std::swap(Pictures::strokes, Pictures::darkStrokes);
+}
+
+void Detection::castRays(const std::vector<EdgePixel>& edges, const int directions, const Config::Parameters& rayParameters)
+{
+    {
+        Profiler::Span span("buildRays");
+        rays = Ray::buildRays(edges, rayParameters, directions);
+        Memory::count("rays", (double) edges.capacity() * sizeof(EdgePixel) + Ray::allocatedBytes(rays));
+    }
+    {
+        Profiler::Span span("drawRays");
+        Ray::drawRays(rays);
+        Ray::release(rays);
+        rays.clear();
+        if(parameters.rayDensity < 1)
+            Ray::fillGaps(parameters.rayDensity);
+    }
+}
+
+void Detection::group()
+{
+    identifyLetterCandidates();
+    identifyLineCandidates();
+}
+
+void Detection::identifyLetterCandidates()
+{
+    {
+        Profiler::Span span("identifyLetterCandidates");
+        components = Component::findAll(parameters);
+        Memory::count("components", Component::allocatedBytes(components));
+        equivalenceClasses = Component::collectEquivalenceClasses(components);
+        letterCandidates = Component::identifyLetterCandidates(equivalenceClasses, parameters);
+        if(!Pictures::darkStrokes.empty()) {
+            std::swap(Pictures::strokes, Pictures::darkStrokes);
+            const std::list<Component*> darkComponents = Component::findAll(parameters);
+            const std::set<const std::vector<Component*>*> darkEquivalenceClasses = Component::collectEquivalenceClasses(darkComponents);
+            const std::vector<LetterCandidate*> darkLetterCandidates = Component::identifyLetterCandidates(darkEquivalenceClasses, parameters);
+            std::swap(Pictures::strokes, Pictures::darkStrokes);
+            components.insert(components.end(), darkComponents.begin(), darkComponents.end());
+            equivalenceClasses.insert(darkEquivalenceClasses.begin(), darkEquivalenceClasses.end());
+            letterCandidates.insert(letterCandidates.end(), darkLetterCandidates.begin(), darkLetterCandidates.end());
+        }
+    }
+    Profiler::count("components", components.size());
+    Profiler::count("equivalenceClasses", equivalenceClasses.size());
+}
+
+void Detection::identifyLineCandidates()
+{
+    {
+        Profiler::Span span("identifyLineCandidates");
+        lineCandidates = LetterCandidate::identifyLineCandidates(letterCandidates, parameters);
+    }
+    Profiler::count("letterCandidates", letterCandidates.size());
+    Profiler::count("lineCandidates", lineCandidates.size());
+}
+
+/*
+    The first grouping is the one of config.ini and uses the candidates of
+    the detection itself, the others get copies made before it starts
+    sorting them and run concurrently next to it.
+*/
+std::vector<std::vector<DetectedLine> > Detection::identifyLines(const std::vector<Config::Grouping>& groupings)
+{
+    std::vector<GroupingRun> runs(groupings.size() > 1 ? groupings.size() - 1 : 0);
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i != runs.size(); ++i) {
+        runs[i].letterCandidates = LetterCandidate::copy(letterCandidates);
+        runs[i].grouping = &groupings[i + 1];
+        threads.push_back(std::thread(runGrouping, &runs[i]));
+    }
+    identifyLineCandidates();
+    std::vector<std::vector<DetectedLine> > lines(1, this->lines());
+    for(size_t i = 0; i != runs.size(); ++i) {
+        threads[i].join();
+        Profiler::addInterval("identifyLineCandidates." + runs[i].grouping->name, runs[i].start, runs[i].seconds);
+        lines.push_back(runs[i].lines);
+    }
+    return lines;
+}
+
+std::vector<DetectedLine> Detection::lines() const
+{
+    return Detection::linesOf(lineCandidates);
+}
+
+std::vector<DetectedLine> Detection::linesOf(const std::vector<LineCandidate*>& lineCandidates)
+{
+    std::vector<DetectedLine> lines;
+    lines.reserve(lineCandidates.size());
+    for(std::vector<LineCandidate*>::const_iterator i = lineCandidates.begin(); i != lineCandidates.end(); ++i) {
+        DetectedLine line;
+        line.boundingRect = (*i)->getBoundingRect();
+        line.rotatedBoundingRect = (*i)->getRotatedBoundingRect();
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+Detection::~Detection()
+{
+    LetterCandidate::release(letterCandidates, lineCandidates);
+    Component::release(components, equivalenceClasses);
+    Ray::release(rays);
+    for(std::vector<Contour*>::const_iterator i = contours.begin(); i != contours.end(); ++i) {
+        delete *i;
+    }
+}
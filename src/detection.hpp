@@ -0,0 +1,61 @@
+#ifndef OCTOSHARK_DETECTION_HPP
+#define OCTOSHARK_DETECTION_HPP
+
+#include <list>
+#include <set>
+#include <string>
+#include <vector>
+#include <opencv/cv.h>
+#include "config.hpp"
+
+class Contour;
+struct EdgePixel;
+class Ray;
+class Component;
+class LetterCandidate;
+class LineCandidate;
+
+/*
+    Where a line was found, kept after the detection that found it is gone.
+*/
+struct DetectedLine {
+    cv::Rect boundingRect;
+    cv::RotatedRect rotatedBoundingRect;
+};
+
+/*
+    One run of the detection pipeline over the pictures of the calling
+    thread. Everything allocated on the way is owned by the detection and
+    freed with it, so long running processes don't accumulate garbage.
+    castRays leaves the strokes in Pictures::strokes (and, for mixed
+    polarities, Pictures::darkStrokes), group may run on
+    another thread once it has the strokes and the original. Letter
+    candidates put in from elsewhere only need identifyLineCandidates.
+    identifyLines groups the letter candidates once per grouping
+    configuration, each on its own copies and thread.
+*/
+class Detection {
+    const Config::Parameters& parameters;
+    std::vector<Contour*> contours;
+    std::list<Ray*> rays;
+    std::list<Component*> components;
+    std::set<const std::vector<Component*>*> equivalenceClasses;
+    void castRays(const std::vector<EdgePixel>& edges, const int directions, const Config::Parameters& rayParameters);
+    Detection(const Detection&);
+    Detection& operator=(const Detection&);
+public:
+    std::vector<LetterCandidate*> letterCandidates;
+    std::vector<LineCandidate*> lineCandidates;
+    void run();
+    void castRays();
+    void group();
+    void identifyLetterCandidates();
+    void identifyLineCandidates();
+    std::vector<std::vector<DetectedLine> > identifyLines(const std::vector<Config::Grouping>& groupings);
+    std::vector<DetectedLine> lines() const;
+    static std::vector<DetectedLine> linesOf(const std::vector<LineCandidate*>& lineCandidates);
+    Detection(const Config::Parameters& parameters) : parameters(parameters) {};
+    ~Detection();
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "extraction.hpp"
+#include "profiler.hpp"
+#include <opencv/highgui.h>
+#include <iostream>
+#include <sstream>
+
+ExtractionWriter::ExtractionWriter(const int threadCount, const int queueSize, const int compression, const int quality) :
+    jobs(queueSize)
+{
+    const std::string format = IMAGE_FORMAT;
+    if(format == ".png") {
+        encodingParameters.push_back(CV_IMWRITE_PNG_COMPRESSION);
+        encodingParameters.push_back(compression);
+    } else if(format == ".jpg" || format == ".jpeg") {
+        encodingParameters.push_back(CV_IMWRITE_JPEG_QUALITY);
+        encodingParameters.push_back(quality);
+    }
+    for(int i = 0; i < std::max(threadCount, 1); ++i) {
+        workers.push_back(std::thread(ExtractionWriter::work, this));
+    }
+}
+
+ExtractionWriter::~ExtractionWriter()
+{
+    this->finish();
+}
+
+void ExtractionWriter::enqueue(const cv::Mat& original, const std::vector<DetectedLine>& lines, const std::string& filePrefix)
+{
+    const cv::Rect imageRect(0, 0, original.cols, original.rows);
+    int x = 0;
+    for(std::vector<DetectedLine>::const_iterator i = lines.begin(); i != lines.end(); ++i) {
+        Job job;
+        job.rotatedRect = i->rotatedBoundingRect;
+        const cv::Rect cropRect = job.rotatedRect.boundingRect() & imageRect;
+        if(cropRect.width <= 0 || cropRect.height <= 0)
+            continue;
+        // the original is reused for the next image, so the writer needs its own copy
+        job.crop = cv::Mat(original, cropRect).clone();
+        job.rotatedRect.center.x -= cropRect.x;
+        job.rotatedRect.center.y -= cropRect.y;
+        std::stringstream fileName;
+        fileName<<filePrefix<<'_'<<x++<<IMAGE_FORMAT;
+        job.fileName = fileName.str();
+        jobs.push(job);
+    }
+}
+
+void ExtractionWriter::finish()
+{
+    jobs.close();
+    for(std::vector<std::thread>::iterator i = workers.begin(); i != workers.end(); ++i) {
+        if(i->joinable())
+            i->join();
+    }
+}
+
+/*
+    minAreaRect reports angles in [-90, 0), steep angles are turned into
+    their complement so lines end up horizontal instead of upright.
+*/
+cv::Mat ExtractionWriter::deskew(const Job& job)
+{
+    float angle = job.rotatedRect.angle;
+    cv::Size size(cvRound(job.rotatedRect.size.width), cvRound(job.rotatedRect.size.height));
+    if(angle < -45) {
+        angle += 90;
+        std::swap(size.width, size.height);
+    }
+    if(angle == 0 || size.width <= 0 || size.height <= 0)
+        return job.crop;
+    cv::Mat rotationMatrix = cv::getRotationMatrix2D(job.rotatedRect.center, angle, 1.0);
+    rotationMatrix.at<double>(0, 2) += size.width / 2.0 - job.rotatedRect.center.x;
+    rotationMatrix.at<double>(1, 2) += size.height / 2.0 - job.rotatedRect.center.y;
+    cv::Mat rotatedExtraction;
+    cv::warpAffine(job.crop, rotatedExtraction, rotationMatrix, size, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    return rotatedExtraction;
+}
+
+void ExtractionWriter::work(ExtractionWriter* writer)
+{
+    Job job;
+    while(writer->jobs.pop(job)) {
+        Profiler::Span span("writeExtraction");
+        if(!cv::imwrite(job.fileName, ExtractionWriter::deskew(job), writer->encodingParameters))
+            std::cerr<<"Could not write "<<job.fileName<<std::endl;
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef OCTOSHARK_EXTRACTION_HPP
+#define OCTOSHARK_EXTRACTION_HPP
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv/cv.h>
+#include "queue.hpp"
+#include "detection.hpp"
+
+#ifndef IMAGE_FORMAT
+#define IMAGE_FORMAT ".png"
+#endif
+
+/*
+    Writes the extracted lines of an image on a pool of writer threads, so
+    encoding overlaps with the detection of the next image.
+*/
+class ExtractionWriter {
+    struct Job {
+        cv::Mat crop;
+        cv::RotatedRect rotatedRect;
+        std::string fileName;
+    };
+    BoundedQueue<Job> jobs;
+    std::vector<std::thread> workers;
+    std::vector<int> encodingParameters;
+    static void work(ExtractionWriter* writer);
+    static cv::Mat deskew(const Job& job);
+public:
+    void enqueue(const cv::Mat& original, const std::vector<DetectedLine>& lines, const std::string& filePrefix);
+    void finish();
+    ExtractionWriter(const int threadCount, const int queueSize, const int compression, const int quality);
+    ~ExtractionWriter();
+};
+
+#endif
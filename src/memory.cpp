@@ -0,0 +1,167 @@
+#include "memory.hpp"
+#include "pictures.hpp"
+#include "contour.hpp"
+#include "ray.hpp"
+#include "component.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace Constants {
+    // shares of edge and stroke pixels assumed before an image was looked at
+    const double edgePixelShare = 0.1;
+    const double strokePixelShare = 0.25;
+    const double averageRaySteps = 16;
+    // a list node per stroke pixel in Component::strokeWidths and Component::coordinates
+    const double componentBytesPerStrokePixel = 4 * sizeof(void*) + sizeof(StrokeValue) + sizeof(cv::Point);
+    const int bandOverlapByStrokeWidth = 4;
+    const double minimumScale = 0.05;
+}
+
+/*
+    Pictures stay for the whole detection, the contour limit map and the
+    rays are gone before the components are labeled. Automatic polarity
+    may keep dark strokes in a second stroke map, tiled builds keep tiled
+    copies of canny, orientations and strokes besides.
+*/
+double Memory::estimateBytes(const cv::Size& size, const Config::Parameters& parameters)
+{
+    const double pixels = (double) size.width * size.height;
+    const int strokeMaps = parameters.textPolarity == Config::autoPolarity ? 2 : 1;
+    double pictures = pixels * (sizeof(cv::Vec3b) + 2 * sizeof(uchar) + sizeof(cv::Vec2s) + sizeof(ushort) + strokeMaps * sizeof(StrokeValue));
+#ifdef TILED_PICTURES
+    pictures += pixels * (sizeof(uchar) + sizeof(ushort) + sizeof(StrokeValue));
+#endif
+    const double contours = pixels * sizeof(Contour*);
+    const double rays = pixels * Constants::edgePixelShare
+        * (sizeof(EdgePixel) + sizeof(Ray) + 3 * sizeof(void*) + Constants::averageRaySteps * sizeof(cv::Point));
+    const double components = pixels * (sizeof(Component*) + sizeof(uchar) + Constants::strokePixelShare * Constants::componentBytesPerStrokePixel);
+    return pictures + std::max(contours + rays, components);
+}
+
+double Memory::picturesBytes()
+{
+    return Pictures::original.total() * Pictures::original.elemSize()
+        + Pictures::input.total() * Pictures::input.elemSize()
+        + Pictures::gradients.total() * Pictures::gradients.elemSize()
+        + Pictures::canny.total() * Pictures::canny.elemSize()
+        + Pictures::orientations.total() * Pictures::orientations.elemSize()
+        + Pictures::strokes.total() * Pictures::strokes.elemSize()
+        + Pictures::darkStrokes.total() * Pictures::darkStrokes.elemSize()
+#ifdef TILED_PICTURES
+        + Pictures::tiledCanny.allocatedBytes() + Pictures::tiledOrientations.allocatedBytes() + Pictures::tiledStrokes.allocatedBytes()
+#endif
+        ;
+}
+
+/*
+    The decoded image stays in memory while its bands are detected. Bands
+    overlap by a few maximum stroke widths so lines on a border are whole
+    in one of them, if not even two overlaps fit the image is downscaled.
+*/
+Memory::Plan Memory::plan(const cv::Size& size, const double budget, const Config::Parameters& parameters)
+{
+    Plan plan;
+    plan.strategy = "full";
+    plan.estimatedBytes = Memory::estimateBytes(size, parameters);
+    plan.bandHeight = size.height;
+    plan.bandOverlap = 0;
+    plan.scale = 1;
+    if(budget <= 0 || plan.estimatedBytes <= budget)
+        return plan;
+    const double availableBytes = budget - (double) size.width * size.height * (sizeof(cv::Vec3b) + sizeof(uchar));
+    const int overlap = std::min(size.height, Constants::bandOverlapByStrokeWidth * parameters.maxStrokeWidth);
+    const double bandHeight = availableBytes / Memory::estimateBytes(cv::Size(size.width, 1), parameters);
+    if(bandHeight >= 2 * overlap) {
+        plan.strategy = "tiled";
+        plan.bandHeight = bandHeight;
+        plan.bandOverlap = overlap;
+        return plan;
+    }
+    plan.strategy = "downscaled";
+    plan.scale = std::max(Constants::minimumScale, std::sqrt(std::max(availableBytes, 0.0) / plan.estimatedBytes));
+    return plan;
+}
+
+std::vector<std::vector<DetectedLine> > detectPart(const cv::Mat& original, const cv::Mat& input, const Config::Parameters& parameters, const std::vector<Config::Grouping>& groupings)
+{
+    {
+        Profiler::Span span("init");
+        Pictures::initialize(original, input);
+    }
+    Detection detection(parameters);
+    detection.castRays();
+    detection.identifyLetterCandidates();
+    const std::vector<std::vector<DetectedLine> > lines = detection.identifyLines(groupings);
+    Pictures::release();
+    return lines;
+}
+
+/*
+    Every band keeps the lines whose center lies in its half of the
+    overlaps, so lines seen by two bands are reported once.
+*/
+std::vector<std::vector<DetectedLine> > Memory::detect(const cv::Mat& original, const cv::Mat& input, const Config::Parameters& parameters, const std::vector<Config::Grouping>& groupings, const Plan& plan, std::string& strategy)
+{
+    std::stringstream description;
+    description<<"memory strategy "<<plan.strategy;
+    Profiler::count("estimatedBytes", plan.estimatedBytes);
+    std::vector<std::vector<DetectedLine> > lines(groupings.size());
+    if(plan.strategy == "downscaled") {
+        cv::Mat scaledOriginal, scaledInput;
+        cv::resize(original, scaledOriginal, cv::Size(), plan.scale, plan.scale, cv::INTER_AREA);
+        cv::resize(input, scaledInput, cv::Size(), plan.scale, plan.scale, cv::INTER_AREA);
+        lines = detectPart(scaledOriginal, scaledInput, parameters, groupings);
+        for(std::vector<std::vector<DetectedLine> >::iterator grouping = lines.begin(); grouping != lines.end(); ++grouping) {
+            for(std::vector<DetectedLine>::iterator i = grouping->begin(); i != grouping->end(); ++i) {
+                i->boundingRect = cv::Rect(i->boundingRect.x / plan.scale, i->boundingRect.y / plan.scale,
+                    i->boundingRect.width / plan.scale, i->boundingRect.height / plan.scale);
+                i->rotatedBoundingRect.center.x /= plan.scale;
+                i->rotatedBoundingRect.center.y /= plan.scale;
+                i->rotatedBoundingRect.size.width /= plan.scale;
+                i->rotatedBoundingRect.size.height /= plan.scale;
+            }
+        }
+        Profiler::count("scale", plan.scale);
+        description<<" scale "<<plan.scale;
+    } else {
+        const int stride = plan.bandHeight - plan.bandOverlap;
+        int bands = 0;
+        for(int top = 0; ; top += stride) {
+            const int bottom = std::min(top + plan.bandHeight, original.rows);
+            const cv::Rect band(0, top, original.cols, bottom - top);
+            const std::vector<std::vector<DetectedLine> > bandLines = detectPart(original(band), input(band), parameters, groupings);
+            const int ownedTop = top == 0 ? 0 : top + plan.bandOverlap / 2;
+            const int ownedBottom = bottom == original.rows ? bottom : bottom - plan.bandOverlap / 2;
+            for(size_t grouping = 0; grouping != bandLines.size(); ++grouping) {
+                for(std::vector<DetectedLine>::const_iterator i = bandLines[grouping].begin(); i != bandLines[grouping].end(); ++i) {
+                    DetectedLine line = *i;
+                    line.boundingRect.y += top;
+                    line.rotatedBoundingRect.center.y += top;
+                    const int centerY = line.boundingRect.y + line.boundingRect.height / 2;
+                    if(centerY >= ownedTop && centerY < ownedBottom)
+                        lines[grouping].push_back(line);
+                }
+            }
+            ++bands;
+            if(bottom == original.rows)
+                break;
+        }
+        Profiler::count("bands", bands);
+        if(bands > 1)
+            description<<" bands "<<bands;
+    }
+    strategy = description.str();
+    return lines;
+}
+
+/*
+    Stages of the bands of one image run one after another, so the largest
+    allocation is what counts.
+*/
+void Memory::count(const char* stage, const double bytes)
+{
+    double& counter = Profiler::currentImage().counters[std::string("bytes.").append(stage)];
+    counter = std::max(counter, bytes);
+}
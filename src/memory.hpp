@@ -0,0 +1,34 @@
+#ifndef OCTOSHARK_MEMORY_HPP
+#define OCTOSHARK_MEMORY_HPP
+
+#include <string>
+#include <vector>
+#include <opencv/cv.h>
+#include "config.hpp"
+#include "detection.hpp"
+
+/*
+    Memory budget of a detection. The footprint of every stage grows with
+    the image, the stroke pixels and the edge pixels, so the peak is
+    estimated from the image size before detecting. Images that would
+    exceed the budget are detected in horizontal bands, or downscaled if
+    even a band does not fit. The stages report what they actually
+    allocated as bytes counters of the profile.
+*/
+namespace Memory {
+    struct Plan {
+        std::string strategy;
+        double estimatedBytes;
+        int bandHeight;
+        int bandOverlap;
+        double scale;
+    };
+
+    double estimateBytes(const cv::Size& size, const Config::Parameters& parameters);
+    double picturesBytes();
+    Plan plan(const cv::Size& size, const double budget, const Config::Parameters& parameters);
+    std::vector<std::vector<DetectedLine> > detect(const cv::Mat& original, const cv::Mat& input, const Config::Parameters& parameters, const std::vector<Config::Grouping>& groupings, const Plan& plan, std::string& strategy);
+    void count(const char* stage, const double bytes);
+}
+
+#endif
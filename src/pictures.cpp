@@ -2,31 +2,141 @@
 #include "config.hpp"
 #include <opencv/highgui.h>
 #include <iostream>
+#include <limits>
 
 namespace Constants {
-    const float strokeBackground = 10.0;
+    const StrokeValue strokeBackground = std::numeric_limits<StrokeValue>::max();
+    const int orientationBinsPerDegree = 4;
+    const int orientationHalfTurn = 180 * orientationBinsPerDegree;
+    const ushort noOrientation = std::numeric_limits<ushort>::max();
 }
 
+// every detection thread works on its own set of pictures
 namespace Pictures {
-	cv::Mat_<cv::Vec3b> original;
-    cv::Mat_<uchar> input;
-    cv::Mat_<short> sobelX;
-    cv::Mat_<short> sobelY;
-    cv::Mat_<uchar> canny;
-    cv::Mat_<float> strokes;
+	thread_local cv::Mat original;
+    thread_local cv::Mat_<uchar> input;
+    thread_local cv::Mat_<cv::Vec2s> gradients;
+    thread_local cv::Mat_<uchar> canny;
+    thread_local cv::Mat_<ushort> orientations;
+    thread_local cv::Mat_<StrokeValue> strokes;
+    thread_local cv::Mat_<StrokeValue> darkStrokes;
+#ifdef TILED_PICTURES
+    thread_local TiledPicture<uchar> tiledCanny;
+    thread_local TiledPicture<ushort> tiledOrientations;
+    thread_local TiledPicture<StrokeValue> tiledStrokes;
+#endif
 }
 
 void Pictures::initialize()
 {
-	original = cv::imread(Config::inputFileName, 1);
-	if(original.cols == 0 || original.rows == 0)
+    cv::Mat decodedOriginal, decodedInput;
+    Pictures::decode(Config::inputFileName, decodedOriginal, decodedInput);
+    Pictures::initialize(decodedOriginal, decodedInput);
+}
+
+/*
+    Images stored with a single channel are decoded once and serve as
+    original and input, color images are decoded in color and grayscale.
+    With decodeGrayscale every image is decoded single channel.
+*/
+void Pictures::decode(const std::string& fileName, cv::Mat& decodedOriginal, cv::Mat& decodedInput)
+{
+	decodedOriginal = cv::imread(fileName, Config::parameters.decodeGrayscale ? 0 : cv::IMREAD_ANYCOLOR);
+	if(decodedOriginal.cols == 0 || decodedOriginal.rows == 0)
+        throw "Could not read inputfile.";
+    decodedInput = decodedOriginal.channels() == 1 ? decodedOriginal : cv::imread(fileName, 0);
+}
+
+void Pictures::initialize(const cv::Mat& decodedOriginal, const cv::Mat& decodedInput)
+{
+    original = decodedOriginal;
+    input = decodedInput;
+    const Config::Parameters& parameters = Config::parameters;
+    {
+        cv::Mat sobel[2];
+        cv::Sobel(input, sobel[0], CV_16S, 1, 0, parameters.apertureSize, 1, 0, cv::BORDER_REPLICATE);
+        cv::Sobel(input, sobel[1], CV_16S, 0, 1, parameters.apertureSize, 1, 0, cv::BORDER_REPLICATE);
+        cv::merge(sobel, 2, gradients);
+    }
+    cv::Canny(input, canny, parameters.cannyThreshold1, parameters.cannyThreshold2,
+                                parameters.apertureSize, parameters.accurateCanny);
+    Pictures::computeOrientations();
+#ifdef TILED_PICTURES
+    tiledCanny.assign(canny);
+    tiledOrientations.assign(orientations);
+#endif
+    strokes = cv::Mat_<StrokeValue>(input.size(), Constants::strokeBackground);
+    darkStrokes.release();
+}
+
+/*
+    Every ray of an edge pixel and every ray ending on it needs its
+    orientation, so it is computed once per edge pixel: the gradients of
+    all edge pixels are gathered and cv::phase converts them in one
+    vectorized pass. Pixels off the edges keep undefined values.
+*/
+void Pictures::computeOrientations()
+{
+    orientations = cv::Mat_<ushort>(canny.size());
+    const int edgePixels = cv::countNonZero(canny);
+    if(edgePixels == 0)
+        return;
+    cv::Mat_<float> gradientsX(1, edgePixels), gradientsY(1, edgePixels), angles;
+    int edge = 0;
+    for(int y = 0; y < canny.rows; ++y) {
+        const uchar* const cannyRow = canny[y];
+        const cv::Vec2s* const gradientRow = gradients[y];
+        for(int x = 0; x < canny.cols; ++x) {
+            if(cannyRow[x] != 0) {
+                gradientsX(0, edge) = gradientRow[x][0];
+                gradientsY(0, edge) = gradientRow[x][1];
+                ++edge;
+            }
+        }
+    }
+    cv::phase(gradientsX, gradientsY, angles, true);
+    const float* const angle = angles[0];
+    edge = 0;
+    for(int y = 0; y < canny.rows; ++y) {
+        const uchar* const cannyRow = canny[y];
+        const cv::Vec2s* const gradientRow = gradients[y];
+        ushort* const orientationRow = orientations[y];
+        for(int x = 0; x < canny.cols; ++x) {
+            if(cannyRow[x] == 0)
+                continue;
+            if(gradientRow[x][0] == 0 && gradientRow[x][1] == 0) {
+                orientationRow[x] = Constants::noOrientation;
+            } else {
+                const int bin = (int) (angle[edge] * Constants::orientationBinsPerDegree + 0.5f);
+                orientationRow[x] = bin % Constants::orientationHalfTurn;
+            }
+            ++edge;
+        }
+    }
+}
+
+void Pictures::decode(const std::vector<uchar>& bytes, cv::Mat& decodedOriginal, cv::Mat& decodedInput)
+{
+    decodedOriginal = cv::imdecode(cv::Mat(bytes), Config::parameters.decodeGrayscale ? 0 : cv::IMREAD_ANYCOLOR);
+	if(decodedOriginal.cols == 0 || decodedOriginal.rows == 0)
         throw "Could not read inputfile.";
-    input = cv::imread(Config::inputFileName, 0);
-    cv::Sobel(input, sobelX, CV_16S, 1, 0, Config::variables["apertureSize"], 1, 0, cv::BORDER_REPLICATE);
-    cv::Sobel(input, sobelY, CV_16S, 0, 1, Config::variables["apertureSize"], 1, 0, cv::BORDER_REPLICATE);
-    cv::Canny(input, canny, Config::variables["cannyThreshold1"], Config::variables["cannyThreshold2"],
-                                Config::variables["apertureSize"], Config::variables["accurateCanny"]);
-    strokes = cv::Mat(input.size(), CV_32FC1, cv::Scalar(Constants::strokeBackground));
+    decodedInput = decodedOriginal.channels() == 1 ? decodedOriginal : cv::imdecode(cv::Mat(bytes), 0);
+}
+
+void Pictures::release()
+{
+    original.release();
+    input.release();
+    gradients.release();
+    canny.release();
+    orientations.release();
+    strokes.release();
+    darkStrokes.release();
+#ifdef TILED_PICTURES
+    tiledCanny.release();
+    tiledOrientations.release();
+    tiledStrokes.release();
+#endif
 }
 
 void Pictures::save()
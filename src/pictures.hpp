@@ -1,18 +1,94 @@
+#ifndef OCTOSHARK_PICTURES_HPP
+#define OCTOSHARK_PICTURES_HPP
+
+#include <string>
+#include <vector>
 #include <opencv/cv.h>
 
+/*
+    Stroke widths are whole pixel lengths below maxStrokeWidth. They
+    are stored as is, the largest representable value marks background.
+    Build with -D WIDE_STROKES for maxStrokeWidth above 254.
+*/
+#ifdef WIDE_STROKES
+typedef ushort StrokeValue;
+#else
+typedef uchar StrokeValue;
+#endif
+
+/*
+    A picture in 8x8 tiles stored one after another, row by row, so a
+    ray marching in any direction stays within a cache line for several
+    steps. A tile of uchar is one cache line. The tiles cover whole tiles
+    beyond the picture, which nobody reads.
+*/
+template<typename T>
+class TiledPicture {
+    std::vector<T> pixels;
+    int tilesX;
+public:
+    T& operator()(const int y, const int x) { return pixels[((((y >> 3) * tilesX) + (x >> 3)) << 6) | ((y & 7) << 3) | (x & 7)]; }
+    const T& operator()(const int y, const int x) const { return pixels[((((y >> 3) * tilesX) + (x >> 3)) << 6) | ((y & 7) << 3) | (x & 7)]; }
+    double allocatedBytes() const { return pixels.capacity() * sizeof(T); }
+    void release() { std::vector<T>().swap(pixels); }
+    void assign(const cv::Mat_<T>& picture)
+    {
+        tilesX = (picture.cols + 7) >> 3;
+        pixels.assign((size_t) tilesX * ((picture.rows + 7) >> 3) << 6, T());
+        for(int y = 0; y < picture.rows; ++y) {
+            const T* const row = picture[y];
+            for(int x = 0; x < picture.cols; ++x) {
+                (*this)(y, x) = row[x];
+            }
+        }
+    }
+    void copyTo(cv::Mat_<T>& picture) const
+    {
+        for(int y = 0; y < picture.rows; ++y) {
+            T* const row = picture[y];
+            for(int x = 0; x < picture.cols; ++x) {
+                row[x] = (*this)(y, x);
+            }
+        }
+    }
+};
+
 namespace Pictures {   
     void initialize();
+    void initialize(const cv::Mat& original, const cv::Mat& input);
+    void decode(const std::string& fileName, cv::Mat& original, cv::Mat& input);
+    void decode(const std::vector<uchar>& bytes, cv::Mat& original, cv::Mat& input);
+    void computeOrientations();
+    void release();
     void save();
     void show();
     
-    extern cv::Mat_<cv::Vec3b> original;
-    extern cv::Mat_<uchar> input;
-    extern cv::Mat_<short> sobelX;
-    extern cv::Mat_<short> sobelY;
-    extern cv::Mat_<uchar> canny;
-    extern cv::Mat_<float> strokes;
+    // BGR, or the input itself for single channel images
+    extern thread_local cv::Mat original;
+    extern thread_local cv::Mat_<uchar> input;
+    extern thread_local cv::Mat_<cv::Vec2s> gradients;
+    extern thread_local cv::Mat_<uchar> canny;
+    extern thread_local cv::Mat_<ushort> orientations;
+    extern thread_local cv::Mat_<StrokeValue> strokes;
+    // empty unless the polarities are kept apart, strokes then holds light text only
+    extern thread_local cv::Mat_<StrokeValue> darkStrokes;
+#ifdef TILED_PICTURES
+    // what ray marching reads and writes, tiled by initialize and drawRays
+    extern thread_local TiledPicture<uchar> tiledCanny;
+    extern thread_local TiledPicture<ushort> tiledOrientations;
+    extern thread_local TiledPicture<StrokeValue> tiledStrokes;
+#endif
 }
 
+/*
+    Gradient orientations of edge pixels are folded to half a turn and
+    quantized, so rays compare them as integers.
+*/
 namespace Constants {
-    extern const float strokeBackground;
+    extern const StrokeValue strokeBackground;
+    extern const int orientationBinsPerDegree;
+    extern const int orientationHalfTurn;
+    extern const ushort noOrientation;
 }
+
+#endif
@@ -0,0 +1,265 @@
+#include "pipeline.hpp"
+#include "pictures.hpp"
+#include "detection.hpp"
+#include "memory.hpp"
+#include "cache.hpp"
+#include "corpus.hpp"
+#include "profiler.hpp"
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#ifdef IMAGE_OUTPUT
+#include "extraction.hpp"
+#endif
+
+struct Pipeline::Job {
+    std::string fileName;
+    cv::Mat original;
+    cv::Mat input;
+    cv::Mat_<StrokeValue> strokes;
+    cv::Mat_<StrokeValue> darkStrokes;
+    std::string imageHash;
+    MappedFile* mappedStrokes;
+    bool cachedLetterCandidates;
+    Detection* detection;
+    std::vector<std::vector<DetectedLine> > lines;
+    std::string strategy;
+    Profiler::Image profile;
+    double queuedAt;
+};
+
+Pipeline::Pipeline(const Config::Parameters& parameters, const std::vector<Config::Grouping>& groupings, const std::vector<std::string>& fileNames, ExtractionWriter* extractionWriter, const ArtifactCache* cache, CorpusWriter* corpus) :
+    parameters(parameters),
+    extractionWriter(extractionWriter),
+    cache(cache),
+    corpus(corpus),
+    groupings(groupings),
+    fileNames(fileNames),
+    memoryBudget(parameters.memoryBudget / (parameters.pipelineRayThreads + parameters.pipelineGroupingThreads)),
+    nextFile(0),
+    runningDecoders(parameters.pipelineDecodeThreads),
+    runningRayCasters(parameters.pipelineRayThreads),
+    decoded(parameters.pipelineQueueSize),
+    cast(parameters.pipelineQueueSize)
+    {}
+
+void Pipeline::run()
+{
+    std::vector<std::thread> threads;
+    for(int i = 0; i < parameters.pipelineDecodeThreads; ++i)
+        threads.push_back(std::thread(Pipeline::decode, this));
+    for(int i = 0; i < parameters.pipelineRayThreads; ++i)
+        threads.push_back(std::thread(Pipeline::castRays, this));
+    for(int i = 0; i < parameters.pipelineGroupingThreads; ++i)
+        threads.push_back(std::thread(Pipeline::group, this));
+    for(std::vector<std::thread>::iterator i = threads.begin(); i != threads.end(); ++i) {
+        i->join();
+    }
+}
+
+/*
+    Hands a job with the profile of its image to the next stage.
+*/
+void Pipeline::send(Job* job, BoundedQueue<Job*>& queue)
+{
+    job->profile = Profiler::detachImage();
+    job->queuedAt = Profiler::now();
+    queue.push(job);
+}
+
+/*
+    Waits for the next job of a stage and continues its profile on this
+    thread. How long the stage starved and how long the image sat in the
+    queue, which includes the previous stage being blocked on a full queue,
+    are added to the image so stages can be balanced.
+*/
+Pipeline::Job* Pipeline::receive(BoundedQueue<Job*>& queue, const char* starvedName, const char* queuedName)
+{
+    const double start = Profiler::now();
+    Job* job;
+    if(!queue.pop(job))
+        return NULL;
+    const double received = Profiler::now();
+    Profiler::attachImage(job->profile);
+    Profiler::addInterval(starvedName, start, received - start);
+    Profiler::addInterval(queuedName, job->queuedAt, received - job->queuedAt);
+    return job;
+}
+
+void Pipeline::decode(Pipeline* pipeline)
+{
+    for(size_t i = pipeline->nextFile++; i < pipeline->fileNames.size(); i = pipeline->nextFile++) {
+        Job* job = new Job();
+        job->fileName = pipeline->fileNames[i];
+        job->detection = NULL;
+        job->mappedStrokes = NULL;
+        job->cachedLetterCandidates = false;
+        Profiler::startImage(job->fileName);
+        try {
+            Profiler::Span span("decode");
+            if(pipeline->cache != NULL) {
+                const std::vector<uchar> bytes = ArtifactCache::read(job->fileName);
+                job->imageHash = ArtifactCache::hash((const char*) bytes.data(), bytes.size());
+                Pictures::decode(bytes, job->original, job->input);
+            } else {
+                Pictures::decode(job->fileName, job->original, job->input);
+            }
+        } catch (const char* e) {
+            Pipeline::drop(job, e);
+            continue;
+        } catch (const std::exception& e) {
+            Pipeline::drop(job, e.what());
+            continue;
+        }
+        Pipeline::send(job, pipeline->decoded);
+    }
+    if(--pipeline->runningDecoders == 0)
+        pipeline->decoded.close();
+}
+
+void Pipeline::castRays(Pipeline* pipeline)
+{
+    Job* job;
+    while((job = Pipeline::receive(pipeline->decoded, "rayCastingStarved", "decodedQueued")) != NULL) {
+        try {
+            const Memory::Plan plan = Memory::plan(job->original.size(), pipeline->memoryBudget, pipeline->parameters);
+            if(plan.strategy != "full") {
+                job->lines = Memory::detect(job->original, job->input, pipeline->parameters, pipeline->groupings, plan, job->strategy);
+            } else {
+                job->detection = new Detection(pipeline->parameters);
+                if(pipeline->memoryBudget > 0)
+                    job->strategy = "memory strategy full";
+                if(pipeline->cache == NULL || !Pipeline::loadFromCache(pipeline->cache, job)) {
+                    {
+                        Profiler::Span span("init");
+                        Pictures::initialize(job->original, job->input);
+                    }
+                    job->detection->castRays();
+                    job->strokes = Pictures::strokes;
+                    job->darkStrokes = Pictures::darkStrokes;
+                    Pictures::release();
+                    if(pipeline->cache != NULL && job->darkStrokes.empty()) {
+                        Profiler::Span span("storeStrokes");
+                        pipeline->cache->storeStrokes(job->imageHash, job->strokes);
+                    }
+                }
+            }
+        } catch (const char* e) {
+            Pipeline::drop(job, e);
+            continue;
+        } catch (const std::exception& e) {
+            Pipeline::drop(job, e.what());
+            continue;
+        }
+        job->input = cv::Mat();
+        Pipeline::send(job, pipeline->cast);
+    }
+    if(--pipeline->runningRayCasters == 0)
+        pipeline->cast.close();
+}
+
+void Pipeline::group(Pipeline* pipeline)
+{
+    Job* job;
+    while((job = Pipeline::receive(pipeline->cast, "groupingStarved", "castQueued")) != NULL) {
+        try {
+            if(job->detection != NULL) {
+                if(!job->cachedLetterCandidates) {
+                    Pictures::original = job->original;
+                    Pictures::strokes = job->strokes;
+                    Pictures::darkStrokes = job->darkStrokes;
+                    job->detection->identifyLetterCandidates();
+                    if(pipeline->cache != NULL) {
+                        Profiler::Span span("storeLetterCandidates");
+                        pipeline->cache->storeLetterCandidates(job->imageHash, job->detection->letterCandidates);
+                    }
+                }
+                job->lines = job->detection->identifyLines(pipeline->groupings);
+                delete job->detection;
+                job->detection = NULL;
+                job->strokes.release();
+                job->darkStrokes.release();
+                Pictures::release();
+                delete job->mappedStrokes;
+                job->mappedStrokes = NULL;
+            }
+            if(pipeline->corpus != NULL) {
+                pipeline->corpus->write(job->fileName, job->lines, job->strategy);
+            } else {
+                for(size_t i = 0; i != job->lines.size(); ++i) {
+                    Pipeline::writeResults(job->fileName, job->original, job->lines[i], pipeline->groupings[i].name, job->strategy, pipeline->extractionWriter);
+                }
+            }
+        } catch (const char* e) {
+            Pipeline::drop(job, e);
+            continue;
+        } catch (const std::exception& e) {
+            Pipeline::drop(job, e.what());
+            continue;
+        }
+        Profiler::finishImage();
+        delete job;
+    }
+}
+
+/*
+    A job failing in any stage is reported and dropped like an image that
+    does not decode, the others go on.
+*/
+void Pipeline::drop(Job* job, const char* error)
+{
+    std::cerr<<job->fileName<<": "<<error<<std::endl;
+    Pictures::release();
+    delete job->detection;
+    delete job->mappedStrokes;
+    Profiler::detachImage();
+    delete job;
+}
+
+/*
+    Cached letter candidates make the stroke map unnecessary, a cached
+    stroke map stays mapped until the job is grouped.
+*/
+bool Pipeline::loadFromCache(const ArtifactCache* cache, Job* job)
+{
+    Profiler::Span span("loadCache");
+    if(cache->loadLetterCandidates(job->imageHash, job->detection->letterCandidates)) {
+        job->cachedLetterCandidates = true;
+        Profiler::count("cachedLetterCandidates", 1);
+        return true;
+    }
+    if(cache->loadStrokes(job->imageHash, job->strokes, job->mappedStrokes)) {
+        Profiler::count("cachedStrokes", 1);
+        return true;
+    }
+    return false;
+}
+
+void Pipeline::writeResults(const std::string& fileName, const cv::Mat& original, const std::vector<DetectedLine>& lines, const std::string& groupingName, const std::string& strategy, ExtractionWriter* extractionWriter)
+{
+#ifdef TEXT_OUTPUT
+    {
+        Profiler::Span span("textOutput");
+        std::fstream outputFileStream(Config::outputFileNameFor(fileName, groupingName).c_str(), std::fstream::out | std::fstream::trunc);
+        outputFileStream<<'#'<<fileName<<std::endl;
+        if(!strategy.empty())
+            outputFileStream<<'#'<<strategy<<std::endl;
+        for(std::vector<DetectedLine>::const_iterator i = lines.begin(); i != lines.end(); ++i) {
+            const cv::Rect currentBoundingBox = i->boundingRect;
+            outputFileStream<<currentBoundingBox.x<<','<<currentBoundingBox.y<<','<<currentBoundingBox.width<<','<<currentBoundingBox.height<<std::endl;
+        }
+    }
+#endif
+#ifdef IMAGE_OUTPUT
+    {
+        Profiler::Span span("enqueueExtractionImages");
+        const size_t directoryIndex = fileName.find_last_of('/');
+        const std::string baseName = directoryIndex == std::string::npos ? fileName : fileName.substr(directoryIndex + 1);
+        std::string filePrefix = std::string(IMAGE_OUTPUT).append(baseName.substr(0, baseName.rfind('.')));
+        if(!groupingName.empty())
+            filePrefix.append(".").append(groupingName);
+        extractionWriter->enqueue(original, lines, filePrefix);
+    }
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef OCTOSHARK_PIPELINE_HPP
+#define OCTOSHARK_PIPELINE_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <opencv/cv.h>
+#include "config.hpp"
+#include "detection.hpp"
+#include "queue.hpp"
+
+class ExtractionWriter;
+class ArtifactCache;
+class CorpusWriter;
+
+/*
+    Batch execution in three stages connected by bounded queues: decoding,
+    ray casting (gradients, contours, rays, strokes) and grouping with
+    writing the results. Each stage runs on its own threads, so the next
+    image decodes while the current one casts rays and the previous one is
+    grouped and written. A memory budget is shared by the images being
+    detected at the same time, images exceeding their share are detected
+    in bands or downscaled on the ray casting threads. With a cache, ray
+    casting and letter candidates are loaded when their parameters match.
+    Every grouping configuration writes its own results from the same
+    letter candidates. With a corpus writer all results go into its
+    files instead of a text file per image.
+*/
+class Pipeline {
+    struct Job;
+    const Config::Parameters& parameters;
+    ExtractionWriter* const extractionWriter;
+    const ArtifactCache* const cache;
+    CorpusWriter* const corpus;
+    const std::vector<Config::Grouping>& groupings;
+    const std::vector<std::string>& fileNames;
+    const double memoryBudget;
+    std::atomic<size_t> nextFile;
+    std::atomic<int> runningDecoders;
+    std::atomic<int> runningRayCasters;
+    BoundedQueue<Job*> decoded;
+    BoundedQueue<Job*> cast;
+    static void decode(Pipeline* pipeline);
+    static void castRays(Pipeline* pipeline);
+    static void group(Pipeline* pipeline);
+    static void send(Job* job, BoundedQueue<Job*>& queue);
+    static void drop(Job* job, const char* error);
+    static bool loadFromCache(const ArtifactCache* cache, Job* job);
+    static Job* receive(BoundedQueue<Job*>& queue, const char* starvedName, const char* queuedName);
+public:
+    Pipeline(const Config::Parameters& parameters, const std::vector<Config::Grouping>& groupings, const std::vector<std::string>& fileNames, ExtractionWriter* extractionWriter, const ArtifactCache* cache, CorpusWriter* corpus);
+    void run();
+    static void writeResults(const std::string& fileName, const cv::Mat& original, const std::vector<DetectedLine>& lines, const std::string& groupingName, const std::string& strategy, ExtractionWriter* extractionWriter);
+};
+
+#endif
@@ -0,0 +1,286 @@
+#include "profiler.hpp"
+#include <sys/resource.h>
+#include <atomic>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#ifdef PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace Profiler {
+    std::mutex mutex;
+    std::ofstream profileStream;
+    std::string traceFileName;
+    std::vector<Event> traceEvents;
+    std::atomic<int> threadCount(0);
+    thread_local int threadId = -1;
+    thread_local Image image;
+    thread_local bool imageIsOpen = false;
+    const double startOfRun = now();
+
+    int currentThread();
+    std::string escape(const std::string& text);
+    void record(const Event& event);
+    std::vector<long long> readHardwareCounters();
+    const char* const hardwareCounterNames[] = {"cycles", "cacheMisses", "branchMisses"};
+}
+
+#ifdef PERF_COUNTERS
+namespace Profiler {
+    thread_local int hardwareCounterGroup = -2;
+    const unsigned int hardwareCounterConfigs[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+}
+
+/*
+    One counter group per thread, opened on first use. Missing permissions
+    (perf_event_paranoid) silently disable the hardware counters.
+*/
+std::vector<long long> Profiler::readHardwareCounters()
+{
+    const int counterCount = sizeof(hardwareCounterConfigs)/sizeof(unsigned int);
+    if(hardwareCounterGroup == -2) {
+        hardwareCounterGroup = -1;
+        for(int i = 0; i != counterCount; ++i) {
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = hardwareCounterConfigs[i];
+            attributes.read_format = PERF_FORMAT_GROUP;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            attributes.disabled = i == 0;
+            const int descriptor = syscall(__NR_perf_event_open, &attributes, 0, -1, hardwareCounterGroup, 0);
+            if(descriptor < 0) {
+                if(hardwareCounterGroup >= 0)
+                    ::close(hardwareCounterGroup);
+                hardwareCounterGroup = -3;
+                break;
+            }
+            if(i == 0)
+                hardwareCounterGroup = descriptor;
+        }
+        if(hardwareCounterGroup >= 0)
+            ioctl(hardwareCounterGroup, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    std::vector<long long> counters;
+    if(hardwareCounterGroup < 0)
+        return counters;
+    unsigned long long values[1 + counterCount];
+    if(read(hardwareCounterGroup, values, sizeof(values)) != sizeof(values))
+        return counters;
+    counters.assign(values + 1, values + 1 + values[0]);
+    return counters;
+}
+#else
+std::vector<long long> Profiler::readHardwareCounters()
+{
+    return std::vector<long long>();
+}
+#endif
+
+double Profiler::now()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1000000000.0;
+}
+
+long Profiler::peakMemoryBytes()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss * 1024L;
+}
+
+std::string Profiler::escape(const std::string& text)
+{
+    std::string escaped;
+    for(std::string::const_iterator i = text.begin(); i != text.end(); ++i) {
+        if(*i == '"' || *i == '\\')
+            escaped.push_back('\\');
+        escaped.push_back(*i);
+    }
+    return escaped;
+}
+
+int Profiler::currentThread()
+{
+    if(threadId < 0)
+        threadId = threadCount++;
+    return threadId;
+}
+
+double Profiler::Image::secondsOf(const std::string& stage) const
+{
+    double seconds = 0;
+    for(std::vector<Event>::const_iterator i = events.begin(); i != events.end(); ++i) {
+        if(i->name == stage)
+            seconds += i->seconds;
+    }
+    return seconds;
+}
+
+Profiler::Span::Span(const char* name) :
+    name(name),
+    hardwareCountersAtStart(Profiler::readHardwareCounters())
+{
+    this->start = Profiler::now();
+}
+
+Profiler::Span::~Span()
+{
+    Event event;
+    event.seconds = Profiler::now() - this->start;
+    event.name = this->name;
+    event.thread = Profiler::currentThread();
+    event.start = this->start;
+    event.hardwareCounters = Profiler::readHardwareCounters();
+    for(size_t i = 0; i < event.hardwareCounters.size() && i < hardwareCountersAtStart.size(); ++i) {
+        event.hardwareCounters[i] -= hardwareCountersAtStart[i];
+    }
+    if(imageIsOpen)
+        image.events.push_back(event);
+    Profiler::record(event);
+}
+
+void Profiler::record(const Event& event)
+{
+    if(traceFileName.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    traceEvents.push_back(event);
+}
+
+void Profiler::open(const std::string& profileFileName, const std::string& traceFileName)
+{
+    if(!profileFileName.empty()) {
+        profileStream.open(profileFileName.c_str(), std::fstream::out | std::fstream::trunc);
+        if(!profileStream.is_open())
+            throw "Profile file could not be opened.";
+    }
+    Profiler::traceFileName = traceFileName;
+}
+
+void Profiler::startImage(const std::string& name)
+{
+    image = Image();
+    image.name = name;
+    imageIsOpen = true;
+}
+
+/*
+    An image handed from one thread to another, as in the batch pipeline,
+    is detached from the first and attached to the second.
+*/
+Profiler::Image Profiler::detachImage()
+{
+    imageIsOpen = false;
+    return image;
+}
+
+void Profiler::attachImage(const Image& attachedImage)
+{
+    image = attachedImage;
+    imageIsOpen = true;
+}
+
+/*
+    Time measured elsewhere, like waits between pipeline stages. It only
+    goes to the image, the trace keeps the spans of each thread.
+*/
+void Profiler::addInterval(const std::string& name, const double start, const double seconds)
+{
+    if(!imageIsOpen)
+        return;
+    Event event;
+    event.name = name;
+    event.thread = Profiler::currentThread();
+    event.start = start;
+    event.seconds = seconds;
+    image.events.push_back(event);
+}
+
+Profiler::Image& Profiler::currentImage()
+{
+    return image;
+}
+
+void Profiler::count(const std::string& counter, const double value)
+{
+    image.counters[counter] += value;
+}
+
+void Profiler::finishImage()
+{
+    imageIsOpen = false;
+    if(!profileStream.is_open())
+        return;
+    std::map<std::string, double> stages;
+    std::map<std::string, std::vector<long long> > hardwareCounters;
+    for(std::vector<Event>::const_iterator i = image.events.begin(); i != image.events.end(); ++i) {
+        stages[i->name] += i->seconds;
+        std::vector<long long>& sums = hardwareCounters[i->name];
+        sums.resize(i->hardwareCounters.size());
+        for(size_t j = 0; j != i->hardwareCounters.size(); ++j) {
+            sums[j] += i->hardwareCounters[j];
+        }
+    }
+    std::stringstream line;
+    line<<"{\"image\":\""<<Profiler::escape(image.name)<<"\",\"thread\":"<<Profiler::currentThread()<<",\"seconds\":{";
+    for(std::map<std::string, double>::const_iterator i = stages.begin(); i != stages.end(); ++i) {
+        line<<(i == stages.begin() ? "" : ",")<<'"'<<i->first<<"\":"<<i->second;
+    }
+    line<<"},\"counters\":{";
+    for(std::map<std::string, double>::const_iterator i = image.counters.begin(); i != image.counters.end(); ++i) {
+        line<<(i == image.counters.begin() ? "" : ",")<<'"'<<i->first<<"\":"<<i->second;
+    }
+    line<<"}";
+    if(!hardwareCounters.empty() && !hardwareCounters.begin()->second.empty()) {
+        line<<",\"hardware\":{";
+        for(std::map<std::string, std::vector<long long> >::const_iterator i = hardwareCounters.begin(); i != hardwareCounters.end(); ++i) {
+            line<<(i == hardwareCounters.begin() ? "" : ",")<<'"'<<i->first<<"\":{";
+            for(size_t j = 0; j != i->second.size(); ++j) {
+                line<<(j == 0 ? "" : ",")<<'"'<<hardwareCounterNames[j]<<"\":"<<i->second[j];
+            }
+            line<<'}';
+        }
+        line<<'}';
+    }
+    line<<",\"peakMemoryBytes\":"<<Profiler::peakMemoryBytes()<<"}\n";
+    std::lock_guard<std::mutex> lock(mutex);
+    profileStream<<line.str()<<std::flush;
+}
+
+void Profiler::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(profileStream.is_open())
+        profileStream.close();
+    if(traceFileName.empty())
+        return;
+    std::ofstream traceStream(traceFileName.c_str(), std::fstream::out | std::fstream::trunc);
+    traceStream<<"{\"traceEvents\":[";
+    for(std::vector<Event>::const_iterator i = traceEvents.begin(); i != traceEvents.end(); ++i) {
+        traceStream<<(i == traceEvents.begin() ? "\n" : ",\n")
+            <<"{\"name\":\""<<i->name<<"\",\"ph\":\"X\",\"pid\":1,\"tid\":"<<i->thread
+            <<",\"ts\":"<<(long long)((i->start - startOfRun) * 1000000)<<",\"dur\":"<<(long long)(i->seconds * 1000000);
+        if(!i->hardwareCounters.empty()) {
+            traceStream<<",\"args\":{";
+            for(size_t j = 0; j != i->hardwareCounters.size(); ++j) {
+                traceStream<<(j == 0 ? "" : ",")<<'"'<<hardwareCounterNames[j]<<"\":"<<i->hardwareCounters[j];
+            }
+            traceStream<<'}';
+        }
+        traceStream<<'}';
+    }
+    traceStream<<"\n]}\n";
+    traceFileName.clear();
+    traceEvents.clear();
+}
@@ -0,0 +1,53 @@
+#ifndef OCTOSHARK_PROFILER_HPP
+#define OCTOSHARK_PROFILER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+    Per image stage spans and counters on a monotonic clock. Every thread
+    records into its own current image, finishImage appends it as one JSON
+    line to the profile file and all spans of the run end up in a Chrome
+    trace (chrome://tracing, Perfetto). Building with -D PERF_COUNTERS
+    additionally reads cycles, cache and branch misses for every span.
+*/
+namespace Profiler {
+    struct Event {
+        std::string name;
+        int thread;
+        double start;
+        double seconds;
+        std::vector<long long> hardwareCounters;
+    };
+
+    struct Image {
+        std::string name;
+        std::vector<Event> events;
+        std::map<std::string, double> counters;
+        double secondsOf(const std::string& stage) const;
+    };
+
+    class Span {
+        const char* name;
+        double start;
+        std::vector<long long> hardwareCountersAtStart;
+    public:
+        Span(const char* name);
+        ~Span();
+    };
+
+    void open(const std::string& profileFileName, const std::string& traceFileName);
+    void close();
+    double now();
+    void startImage(const std::string& name);
+    void finishImage();
+    Image detachImage();
+    void attachImage(const Image& image);
+    void addInterval(const std::string& name, const double start, const double seconds);
+    Image& currentImage();
+    void count(const std::string& counter, const double value);
+    long peakMemoryBytes();
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef OCTOSHARK_QUEUE_HPP
+#define OCTOSHARK_QUEUE_HPP
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/*
+    Fixed capacity FIFO shared between producer and consumer threads.
+    push blocks while the queue is full, pop blocks while it is empty and
+    returns false once the queue was closed and all items are consumed.
+*/
+template<typename T>
+class BoundedQueue {
+    std::deque<T> items;
+    const size_t capacity;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+public:
+    BoundedQueue(const size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false) {};
+    void push(const T& item);
+    bool pop(T& item);
+    void close();
+};
+
+template<typename T>
+void BoundedQueue<T>::push(const T& item)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(items.size() >= capacity && !closed)
+        notFull.wait(lock);
+    items.push_back(item);
+    notEmpty.notify_one();
+}
+
+template<typename T>
+bool BoundedQueue<T>::pop(T& item)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(items.empty() && !closed)
+        notEmpty.wait(lock);
+    if(items.empty())
+        return false;
+    item = items.front();
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+}
+
+template<typename T>
+void BoundedQueue<T>::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    notEmpty.notify_all();
+    notFull.notify_all();
+}
+
+#endif
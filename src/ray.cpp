@@ -1,20 +1,98 @@
 #include "ray.hpp"
 #include "pictures.hpp"
 #include "config.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <climits>
 #include <cmath>
 #include <iostream>
+#include <sstream>
 
 namespace Constants {
     Ray* nullRay = (Ray*) 0;
+    const int textureOrientationBins = 16;
+    const int textureMinimumEdges = 32;
+    const int strokeWidthSampleSize = 1024;
+    const int minimumStrokeWidthSamples = 64;
+    const int minimumAutoStrokeWidth = 8;
+    // bit reversed positions, the ranks below any threshold are spread evenly
+    const uchar edgeSamplingOrder[64] = {
+         0, 32, 16, 48,  8, 40, 24, 56,  4, 36, 20, 52, 12, 44, 28, 60,
+         2, 34, 18, 50, 10, 42, 26, 58,  6, 38, 22, 54, 14, 46, 30, 62,
+         1, 33, 17, 49,  9, 41, 25, 57,  5, 37, 21, 53, 13, 45, 29, 61,
+         3, 35, 19, 51, 11, 43, 27, 59,  7, 39, 23, 55, 15, 47, 31, 63
+    };
 }
 
-int Ray::maximumStrokeAngle;
-int Ray::maximumStrokeWidth;
-int Ray::maximumStrokeWidthSquared;
+/*
+    Sampling rank of an edge pixel in [0, 64), from its position along the
+    edge: x for mostly horizontal edges, y for mostly vertical ones. The
+    pixels of an edge advance by one in that coordinate, so the ranks
+    below a threshold keep an even share of every edge, whatever row or
+    column it lies on.
+*/
+inline int samplingRank(const EdgePixel& edge)
+{
+    const int position = abs(edge.sobelX) > abs(edge.sobelY) ? edge.y : edge.x;
+    return Constants::edgeSamplingOrder[position & 63];
+}
+
+inline int samplingThreshold(const float density)
+{
+    return std::max(1, (int) std::ceil(density * 64));
+}
+
+/*
+    The most positions in a row along an edge that samplingThreshold
+    leaves out.
+*/
+inline int samplingSpacing(const int threshold)
+{
+    int spacing = 0, run = 0;
+    for(int i = 0; i != 128; ++i) {
+        if(Constants::edgeSamplingOrder[i & 63] < threshold) {
+            spacing = std::max(spacing, run);
+            run = 0;
+        } else
+            ++run;
+    }
+    return spacing;
+}
+
+/*
+    The pictures ray marching touches, tiled when built with
+    TILED_PICTURES and row-major otherwise.
+*/
+inline bool isEdgeAt(const int x, const int y)
+{
+#ifdef TILED_PICTURES
+    return Pictures::tiledCanny(y, x) != 0;
+#else
+    return Pictures::canny(y, x) != 0;
+#endif
+}
+
+inline int orientationAt(const int x, const int y)
+{
+#ifdef TILED_PICTURES
+    return Pictures::tiledOrientations(y, x);
+#else
+    return Pictures::orientations(y, x);
+#endif
+}
+
+inline StrokeValue& strokeAt(const int x, const int y)
+{
+#ifdef TILED_PICTURES
+    return Pictures::tiledStrokes(y, x);
+#else
+    return Pictures::strokes(y, x);
+#endif
+}
 
 bool PointOfInterest::isAt(const int x, const int y)
 {
-    return Pictures::canny.at<uchar>(y, x) != 0;
+    return isEdgeAt(x, y);
 }
 
 void Ray::printSteps()
@@ -40,18 +118,18 @@ Ray::Ray(const PointOfInterest& start, const int sobelX, const int sobelY, const
     {}
 
 void Ray::redraw() {
-    std::vector<float> strokeWidths;
+    std::vector<StrokeValue> strokeWidths;
     strokeWidths.reserve(this->strokeWidth * 2);
     int actPosX = this->start.x;
     int actPosY = this->start.y;
-    strokeWidths.push_back(Pictures::strokes.at<float>(actPosY, actPosX));
+    strokeWidths.push_back(strokeAt(actPosX, actPosY));
     for(std::vector<cv::Point>::const_iterator i = steps.begin(); i != steps.end(); ++i) {
         actPosX += i->x;
         actPosY += i->y;
-        strokeWidths.push_back(Pictures::strokes.at<float>(actPosY, actPosX));
+        strokeWidths.push_back(strokeAt(actPosX, actPosY));
     }
-    std::sort(strokeWidths.begin(), strokeWidths.end());
-    this->strokeWidth = strokeWidths[strokeWidths.size()/2] * Config::variables["maximumStrokeWidth"];
+    std::nth_element(strokeWidths.begin(), strokeWidths.begin() + strokeWidths.size()/2, strokeWidths.end());
+    this->strokeWidth = strokeWidths[strokeWidths.size()/2];
     this->draw();
 }
 
@@ -69,19 +147,21 @@ void Ray::draw() const
 
 void Ray::drawPoint(const int x, const int y) const
 {
-    const float strokeValue = (float) this->strokeWidth / Ray::maximumStrokeWidth;
-    if(Pictures::strokes.at<float>(y, x) > strokeValue) {
-        Pictures::strokes.at<float>(y, x) = strokeValue;
+    const StrokeValue strokeValue = this->strokeWidth;
+    StrokeValue& currentValue = strokeAt(x, y);
+    if(currentValue > strokeValue) {
+        currentValue = strokeValue;
     }
 }
 
-Ray* Ray::build()
+Ray* Ray::build(const Config::Parameters& parameters)
 {
+    const int maximumStrokeWidthSquared = parameters.maxStrokeWidth * parameters.maxStrokeWidth;
     float goalX, goalY;
     goalX = stepX = goalY = stepY = 0;
     steps = std::vector<cv::Point >();
-    steps.reserve(Ray::maximumStrokeWidth);
-    while(furtherStepsArePossible()) {
+    steps.reserve(parameters.maxStrokeWidth);
+    while(furtherStepsArePossible(maximumStrokeWidthSquared)) {
         if(hitEdge()) {
             break;
         }
@@ -96,7 +176,7 @@ Ray* Ray::build()
         }
     }
     // need to check wheter we left because loop condition is invalid or we breaked
-    if(furtherStepsArePossible() && hitEdge() && betweenParallelEdges()) {
+    if(furtherStepsArePossible(maximumStrokeWidthSquared) && hitEdge() && betweenParallelEdges(parameters.maxStrokeAngle * Constants::orientationBinsPerDegree)) {
         strokeWidth = sqrt(stepX * stepX + stepY * stepY);
         return this;
     } else {
@@ -119,21 +199,17 @@ void Ray::takeStepY(const float goalY)
     steps.push_back(cv::Point(0, goalSign));
 }
 
-bool Ray::betweenParallelEdges() const
+/*
+    Both ends are edge pixels, the maximum angle is in orientation bins.
+*/
+bool Ray::betweenParallelEdges(const int maximumStrokeAngle) const
 {
-    const int endX = currentPosX();
-    const int endY = currentPosY();
-    const short endSobelX = Pictures::sobelX.at<short>(endY, endX);
-    const short endSobelY = Pictures::sobelY.at<short>(endY, endX);
-    //still needed?
-    if(endSobelX == 0 && endSobelY == 0) return false;
-    float startAngle = computeAngle(this->sobelX, this->sobelY);
-    float endAngle = computeAngle(endSobelX, endSobelY);
-    if(startAngle < 0) startAngle += 180;
-    if(endAngle < 0) endAngle += 180;
-    const float difference1 = fabs(startAngle - endAngle);
-    const float difference2 = 180 - std::max(startAngle, endAngle) + std::min(startAngle, endAngle);
-    return std::min(difference1, difference2) <= Ray::maximumStrokeAngle;
+    const int startOrientation = orientationAt(start.x, start.y);
+    const int endOrientation = orientationAt(currentPosX(), currentPosY());
+    if(startOrientation == Constants::noOrientation || endOrientation == Constants::noOrientation)
+        return false;
+    const int difference = abs(startOrientation - endOrientation);
+    return std::min(difference, Constants::orientationHalfTurn - difference) <= maximumStrokeAngle;
 }
 
 int Ray::currentPosX() const
@@ -157,9 +233,9 @@ bool Ray::goalReached(const float goal, const int step) const
     }
 }
 
-bool Ray::furtherStepsArePossible() const
+bool Ray::furtherStepsArePossible(const int maximumStrokeWidthSquared) const
 {
-    const bool isNotTooLong = stepX * stepX + stepY * stepY < Ray::maximumStrokeWidthSquared;
+    const bool isNotTooLong = stepX * stepX + stepY * stepY < maximumStrokeWidthSquared;
     const bool isInsideX = currentPosX() > 0 && currentPosX() + 1 < Pictures::canny.cols;
     const bool isInsideY = currentPosY() > 0 && currentPosY() + 1 < Pictures::canny.rows;
     if(this->contour == NULL) {
@@ -172,7 +248,7 @@ bool Ray::furtherStepsArePossible() const
 bool Ray::hitEdge() const
 {
     const bool farEnoughAway = abs(stepX) + abs(stepY) > 2;
-    const bool overEdgePixel = Pictures::canny.at<uchar>(currentPosY(), currentPosX());
+    const bool overEdgePixel = isEdgeAt(currentPosX(), currentPosY());
     return farEnoughAway && overEdgePixel;
     
 }
@@ -189,42 +265,467 @@ float Ray::computeSlope(const float sobel) const
         return sobel / fabs(this->sobelY);
 }
 
-std::list<Ray*> Ray::buildRays(const std::vector<std::vector<Contour*> >& contourLimitMap)
+std::vector<EdgePixel> EdgePixel::collect(const std::vector<std::vector<Contour*> >& contourLimitMap)
 {
-    std::list<Ray*> rays;
-    Ray::maximumStrokeAngle = Config::variables["maximumStrokeAngle"];
-    Ray::maximumStrokeWidth = Config::variables["maximumStrokeWidth"];
-    Ray::maximumStrokeWidthSquared = Ray::maximumStrokeWidth * Ray::maximumStrokeWidth;
-    const int shearingAngles[] = {SHEARING_ANGLES};
+    std::vector<EdgePixel> edges;
+    edges.reserve(cv::countNonZero(Pictures::canny));
     for(int y=0; y<Pictures::canny.rows; ++y) {
+        const uchar* const cannyRow = Pictures::canny[y];
+        const cv::Vec2s* const gradientRow = Pictures::gradients[y];
         for(int x=0; x<Pictures::canny.cols; ++x) {
-            if(PointOfInterest::isAt(x,y)) {
-                PointOfInterest poi(x, y);
-                const int sobelX = Pictures::sobelX.at<short>(y, x);
-                const int sobelY = Pictures::sobelY.at<short>(y, x);
-                const Contour* contour = contourLimitMap[y][x];
-                for(int i=0; i != sizeof(shearingAngles)/sizeof(int); ++i) {
-                    Ray* forwards = new Ray(poi, sobelX, sobelY, shearingAngles[i], contour);
-                    forwards = forwards->build();
-                    if(forwards != NULL) 
-                        rays.push_back(forwards);
-                    Ray* backwards = new Ray(poi, -sobelX, -sobelY, shearingAngles[i], contour);
-                    backwards = backwards->build();
-                    if(backwards != NULL)
-                        rays.push_back(backwards);
+            if(cannyRow[x] != 0) {
+                const EdgePixel edge = {x, y, gradientRow[x][0], gradientRow[x][1], contourLimitMap[y][x]};
+                edges.push_back(edge);
+            }
+        }
+    }
+    return edges;
+}
+
+/*
+    Edge statistics of one tile: orientation histogram and the gaps between
+    consecutive edge pixels of a row.
+*/
+struct TileStatistics {
+    int edges;
+    int histogram[Constants::textureOrientationBins];
+    int gaps;
+    double gapSum;
+    double gapSquareSum;
+    TileStatistics() : edges(0), gaps(0), gapSum(0), gapSquareSum(0) {
+        std::fill(histogram, histogram + Constants::textureOrientationBins, 0);
+    }
+    bool isTexture(const int area, const Config::Parameters& parameters) const;
+};
+
+/*
+    Texture has dense edges in every direction at irregular distances,
+    text has strokes with parallel edges at about the stroke width. Only
+    tiles failing all three are texture, and only with enough edges to
+    tell.
+*/
+bool TileStatistics::isTexture(const int area, const Config::Parameters& parameters) const
+{
+    if(edges < Constants::textureMinimumEdges || gaps < 2 || edges < parameters.textureEdgeDensity * area)
+        return false;
+    double entropy = 0;
+    for(int i = 0; i != Constants::textureOrientationBins; ++i) {
+        if(histogram[i] != 0) {
+            const double share = (double) histogram[i] / edges;
+            entropy -= share * std::log(share);
+        }
+    }
+    if(entropy < parameters.textureOrientationEntropy * std::log((double) Constants::textureOrientationBins))
+        return false;
+    const double meanGap = gapSum / gaps;
+    const double gapVariance = std::max(0.0, gapSquareSum / gaps - meanGap * meanGap);
+    return std::sqrt(gapVariance) >= parameters.textureSpacingVariation * meanGap;
+}
+
+/*
+    Drops the edge pixels of tiles whose statistics say texture, before any
+    ray is cast from them. Rays of the remaining pixels may still cross
+    those tiles.
+*/
+void EdgePixel::dropTextureTiles(std::vector<EdgePixel>& edges, const Config::Parameters& parameters)
+{
+    const int tileSize = parameters.textureTileSize;
+    const int tilesX = (Pictures::canny.cols + tileSize - 1) / tileSize;
+    const int tilesY = (Pictures::canny.rows + tileSize - 1) / tileSize;
+    std::vector<TileStatistics> tiles(tilesX * tilesY);
+    for(size_t i = 0; i != edges.size(); ++i) {
+        const EdgePixel& edge = edges[i];
+        TileStatistics& tile = tiles[(edge.y / tileSize) * tilesX + edge.x / tileSize];
+        ++tile.edges;
+        const int orientation = Pictures::orientations(edge.y, edge.x);
+        if(orientation != Constants::noOrientation)
+            ++tile.histogram[orientation * Constants::textureOrientationBins / Constants::orientationHalfTurn];
+        if(i > 0 && edges[i-1].y == edge.y && edges[i-1].x / tileSize == edge.x / tileSize) {
+            const int gap = edge.x - edges[i-1].x;
+            ++tile.gaps;
+            tile.gapSum += gap;
+            tile.gapSquareSum += gap * gap;
+        }
+    }
+    std::vector<bool> texture(tiles.size());
+    int textureTiles = 0;
+    double textureArea = 0;
+    for(int tileY = 0; tileY != tilesY; ++tileY) {
+        for(int tileX = 0; tileX != tilesX; ++tileX) {
+            const int width = std::min(tileSize, Pictures::canny.cols - tileX * tileSize);
+            const int height = std::min(tileSize, Pictures::canny.rows - tileY * tileSize);
+            if(tiles[tileY * tilesX + tileX].isTexture(width * height, parameters)) {
+                texture[tileY * tilesX + tileX] = true;
+                ++textureTiles;
+                textureArea += width * height;
+            }
+        }
+    }
+    const size_t allEdges = edges.size();
+    std::vector<EdgePixel>::iterator kept = edges.begin();
+    for(std::vector<EdgePixel>::const_iterator i = edges.begin(); i != edges.end(); ++i) {
+        if(!texture[(i->y / tileSize) * tilesX + i->x / tileSize])
+            *kept++ = *i;
+    }
+    edges.erase(kept, edges.end());
+    Profiler::count("textureTiles", textureTiles);
+    Profiler::count("textureArea", textureArea / Pictures::canny.total());
+    Profiler::count("textureEdgePixels", allEdges - edges.size());
+}
+
+/*
+    Casts the rays of the edge pixels of one image and counts attempts and
+    acceptance per shearing angle.
+*/
+class RayCasting {
+    const Config::Parameters& parameters;
+    const std::vector<int>& shearingAngles;
+    const int directions;
+    std::vector<int> outwardOrder;
+    std::vector<int> attemptedRays, acceptedRays;
+    double strokeWidthSum;
+    // shortest accepted stroke per direction of the previous and the current row
+    std::vector<int> previousRowStrokes[2], currentRowStrokes[2];
+    int currentRow;
+    int cast(const EdgePixel& edge, const int direction, const int angleIndex);
+    int localMinimum(const EdgePixel& edge, const int direction) const;
+    void castAdaptively(const EdgePixel& edge, const int direction);
+public:
+    std::list<Ray*> rays;
+    void castAll(const EdgePixel& edge);
+    void castAdaptively(const EdgePixel& edge);
+    void count(const int edgePixels) const;
+    RayCasting(const Config::Parameters& parameters, const int directions);
+};
+
+RayCasting::RayCasting(const Config::Parameters& parameters, const int directions) :
+    parameters(parameters),
+    shearingAngles(parameters.shearingAngles),
+    directions(directions),
+    strokeWidthSum(0),
+    currentRow(-1)
+{
+    attemptedRays.assign(shearingAngles.size(), 0);
+    acceptedRays.assign(shearingAngles.size(), 0);
+    for(size_t i = 0; i != shearingAngles.size(); ++i) {
+        outwardOrder.push_back(i);
+    }
+    for(size_t i = 1; i < outwardOrder.size(); ++i) {
+        for(size_t j = i; j > 0 && abs(shearingAngles[outwardOrder[j]]) < abs(shearingAngles[outwardOrder[j-1]]); --j) {
+            std::swap(outwardOrder[j], outwardOrder[j-1]);
+        }
+    }
+    for(int direction = 0; direction != 2; ++direction) {
+        previousRowStrokes[direction].assign(Pictures::canny.cols, INT_MAX);
+        currentRowStrokes[direction].assign(Pictures::canny.cols, INT_MAX);
+    }
+}
+
+/*
+    Returns the stroke width of the accepted ray or INT_MAX. Direction 0
+    follows the gradient, direction 1 goes against it.
+*/
+int RayCasting::cast(const EdgePixel& edge, const int direction, const int angleIndex)
+{
+    const int sign = direction == 0 ? 1 : -1;
+    ++attemptedRays[angleIndex];
+    Ray* ray = new Ray(PointOfInterest(edge.x, edge.y), sign * edge.sobelX, sign * edge.sobelY, shearingAngles[angleIndex], edge.contour);
+    if(ray->build(parameters) == NULL) {
+        delete ray;
+        return INT_MAX;
+    }
+    rays.push_back(ray);
+    strokeWidthSum += ray->strokeWidth;
+    ++acceptedRays[angleIndex];
+    return ray->strokeWidth;
+}
+
+void RayCasting::castAll(const EdgePixel& edge)
+{
+    for(size_t i = 0; i != shearingAngles.size(); ++i) {
+        if(directions & Ray::alongGradient)
+            this->cast(edge, 0, i);
+        if(directions & Ray::againstGradient)
+            this->cast(edge, 1, i);
+    }
+}
+
+int RayCasting::localMinimum(const EdgePixel& edge, const int direction) const
+{
+    int minimum = edge.x > 0 ? currentRowStrokes[direction][edge.x-1] : INT_MAX;
+    for(int x = std::max(edge.x-1, 0); x <= edge.x+1 && x < (int) previousRowStrokes[direction].size(); ++x) {
+        minimum = std::min(minimum, previousRowStrokes[direction][x]);
+    }
+    return minimum;
+}
+
+void RayCasting::castAdaptively(const EdgePixel& edge)
+{
+    if(edge.y != currentRow) {
+        for(int direction = 0; direction != 2; ++direction) {
+            if(edge.y == currentRow + 1)
+                previousRowStrokes[direction].swap(currentRowStrokes[direction]);
+            else
+                previousRowStrokes[direction].assign(previousRowStrokes[direction].size(), INT_MAX);
+            currentRowStrokes[direction].assign(currentRowStrokes[direction].size(), INT_MAX);
+        }
+        currentRow = edge.y;
+    }
+    if(directions & Ray::alongGradient)
+        this->castAdaptively(edge, 0);
+    if(directions & Ray::againstGradient)
+        this->castAdaptively(edge, 1);
+}
+
+/*
+    Casts the least sheared ray first and keeps it if it is not longer than
+    adaptiveShearingFactor times the shortest stroke found at the already
+    visited neighbours. Otherwise the remaining angles are tried outwards
+    in pairs of growing magnitude until a pair fails to shorten the stroke.
+*/
+void RayCasting::castAdaptively(const EdgePixel& edge, const int direction)
+{
+    int shortest = this->cast(edge, direction, outwardOrder.front());
+    const int neighbourhood = this->localMinimum(edge, direction);
+    if(shortest == INT_MAX || (neighbourhood != INT_MAX && shortest > neighbourhood * parameters.adaptiveShearingFactor)) {
+        size_t i = 1;
+        while(i < outwardOrder.size()) {
+            const int magnitude = abs(shearingAngles[outwardOrder[i]]);
+            bool shortened = false;
+            for(; i < outwardOrder.size() && abs(shearingAngles[outwardOrder[i]]) == magnitude; ++i) {
+                const int strokeWidth = this->cast(edge, direction, outwardOrder[i]);
+                if(strokeWidth < shortest) {
+                    shortest = strokeWidth;
+                    shortened = true;
                 }
             }
+            if(!shortened && shortest != INT_MAX)
+                break;
         }
     }
+    currentRowStrokes[direction][edge.x] = shortest;
+}
+
+void RayCasting::count(const int edgePixels) const
+{
+    Profiler::count("edgePixels", edgePixels);
+    for(size_t i=0; i != shearingAngles.size(); ++i) {
+        std::stringstream angle;
+        angle<<'['<<shearingAngles[i]<<']';
+        Profiler::count("raysAttempted" + angle.str(), attemptedRays[i]);
+        Profiler::count("raysAccepted" + angle.str(), acceptedRays[i]);
+    }
+    Profiler::count("rays", rays.size());
+    Profiler::count("meanRayLength", rays.empty() ? 0 : strokeWidthSum / rays.size());
+}
+
+inline bool orderEdgesByTile(const EdgePixel& a, const EdgePixel& b)
+{
+    if((a.y >> 3) != (b.y >> 3))
+        return a.y < b.y;
+    return (a.x >> 3) < (b.x >> 3);
+}
+
+bool Ray::startsBefore(const Ray* const a, const Ray* const b)
+{
+    return a->start.y < b->start.y || (a->start.y == b->start.y && a->start.x < b->start.x);
+}
+
+/*
+    With a rayDensity below 1 only the edge pixels whose samplingRank is
+    below its threshold cast rays, an even share of every edge and the
+    same for every image.
+    directions are the Directions to cast in.
+
+    With TILED_PICTURES the edge pixels are visited tile by tile, unless
+    adaptive shearing needs the row before, and the rays are put back in
+    row order afterwards, as drawing depends on it.
+*/
+std::list<Ray*> Ray::buildRays(const std::vector<EdgePixel>& edges, const Config::Parameters& parameters, const int directions)
+{
+    RayCasting casting(parameters, directions);
+    const int threshold = samplingThreshold(parameters.rayDensity);
+#ifdef TILED_PICTURES
+    std::vector<EdgePixel> tiledEdges;
+    if(!parameters.adaptiveShearing) {
+        tiledEdges = edges;
+        std::stable_sort(tiledEdges.begin(), tiledEdges.end(), orderEdgesByTile);
+    }
+    const std::vector<EdgePixel>& orderedEdges = parameters.adaptiveShearing ? edges : tiledEdges;
+#else
+    const std::vector<EdgePixel>& orderedEdges = edges;
+#endif
+    for(std::vector<EdgePixel>::const_iterator edge = orderedEdges.begin(); edge != orderedEdges.end(); ++edge) {
+        if(samplingRank(*edge) >= threshold)
+            continue;
+        if(parameters.adaptiveShearing)
+            casting.castAdaptively(*edge);
+        else
+            casting.castAll(*edge);
+    }
+    casting.count(edges.size());
+    std::list<Ray*> rays;
+    rays.swap(casting.rays);
+#ifdef TILED_PICTURES
+    if(!parameters.adaptiveShearing)
+        rays.sort(Ray::startsBefore);
+#endif
     return rays;
 }
 
+inline int leastShearedAngle(const std::vector<int>& shearingAngles)
+{
+    int shearingAngle = shearingAngles.front();
+    for(std::vector<int>::const_iterator i = shearingAngles.begin(); i != shearingAngles.end(); ++i) {
+        if(abs(*i) < abs(shearingAngle))
+            shearingAngle = *i;
+    }
+    return shearingAngle;
+}
+
+/*
+    Casts the least sheared ray both ways from every sixteenth pixel of
+    every edge. Across a stroke a ray meets a parallel edge, into the
+    background it mostly doesn't, so the direction accepting
+    polarityMargin times more rays than the other is the polarity of the
+    text. Without such a majority the content is mixed and both
+    directions are returned.
+*/
+int Ray::estimatePolarity(const std::vector<EdgePixel>& edges, const Config::Parameters& parameters)
+{
+    const int shearingAngle = leastShearedAngle(parameters.shearingAngles);
+    int accepted[2] = {0, 0};
+    for(std::vector<EdgePixel>::const_iterator edge = edges.begin(); edge != edges.end(); ++edge) {
+        if(samplingRank(*edge) >= 4)
+            continue;
+        for(int direction = 0; direction != 2; ++direction) {
+            const int sign = direction == 0 ? 1 : -1;
+            Ray ray(PointOfInterest(edge->x, edge->y), sign * edge->sobelX, sign * edge->sobelY, shearingAngle, edge->contour);
+            if(ray.build(parameters) != NULL)
+                ++accepted[direction];
+        }
+    }
+    Profiler::count("polarityRaysAlong", accepted[0]);
+    Profiler::count("polarityRaysAgainst", accepted[1]);
+    if(accepted[0] > parameters.polarityMargin * accepted[1])
+        return Ray::alongGradient;
+    if(accepted[1] > parameters.polarityMargin * accepted[0])
+        return Ray::againstGradient;
+    return Ray::bothDirections;
+}
+
+/*
+    The ray length cap of one image: autoStrokeWidthFactor times the
+    autoStrokeWidthPercentile of the stroke widths found by the least
+    sheared rays of about strokeWidthSampleSize edge pixels, an even share
+    of every edge. Failed rays, most of them, then stop at about the
+    widest stroke of the image instead of at maxStrokeWidth. Too few
+    accepted rays to tell keep maxStrokeWidth.
+*/
+int Ray::estimateMaxStrokeWidth(const std::vector<EdgePixel>& edges, const Config::Parameters& parameters)
+{
+    if(edges.empty())
+        return parameters.maxStrokeWidth;
+    const int shearingAngle = leastShearedAngle(parameters.shearingAngles);
+    const int threshold = std::min(64, (int) std::ceil(64.0 * Constants::strokeWidthSampleSize / edges.size()));
+    std::vector<int> histogram(parameters.maxStrokeWidth + 1, 0);
+    int accepted = 0;
+    for(std::vector<EdgePixel>::const_iterator edge = edges.begin(); edge != edges.end(); ++edge) {
+        if(samplingRank(*edge) >= threshold)
+            continue;
+        for(int sign = 1; sign >= -1; sign -= 2) {
+            Ray ray(PointOfInterest(edge->x, edge->y), sign * edge->sobelX, sign * edge->sobelY, shearingAngle, edge->contour);
+            if(ray.build(parameters) != NULL) {
+                ++histogram[std::min(ray.strokeWidth, parameters.maxStrokeWidth)];
+                ++accepted;
+            }
+        }
+    }
+    int maximumStrokeWidth = parameters.maxStrokeWidth;
+    if(accepted >= Constants::minimumStrokeWidthSamples) {
+        const int rank = (int) std::ceil(parameters.autoStrokeWidthPercentile * accepted);
+        int strokeWidth = 0;
+        for(int below = histogram[0]; below < rank; below += histogram[++strokeWidth]);
+        maximumStrokeWidth = (int) std::ceil(strokeWidth * parameters.autoStrokeWidthFactor) + 1;
+        maximumStrokeWidth = std::min(parameters.maxStrokeWidth, std::max(Constants::minimumAutoStrokeWidth, maximumStrokeWidth));
+    }
+    Profiler::count("strokeWidthSamples", accepted);
+    Profiler::count("maxStrokeWidth", maximumStrokeWidth);
+    return maximumStrokeWidth;
+}
+
 void Ray::drawRays(std::list<Ray*>& rays)
 {
+#ifdef TILED_PICTURES
+    Pictures::tiledStrokes.assign(Pictures::strokes);
+#endif
     for(std::list<Ray*>::iterator i = rays.begin(); i != rays.end(); ++i) {
         (*i)->draw();
     }
     for(std::list<Ray*>::iterator i = rays.begin(); i != rays.end(); ++i) {
         (*i)->redraw();
     }
+#ifdef TILED_PICTURES
+    Pictures::tiledStrokes.copyTo(Pictures::strokes);
+    Pictures::tiledStrokes.release();
+#endif
+}
+
+/*
+    Fills each background run of a row or column of strokes that lies
+    between drawn strokes and is at most spacing pixels long, with the
+    narrower of the two strokes.
+*/
+inline void fillRun(const StrokeValue* const drawn, const int drawnStep, StrokeValue* const strokes, const int strokesStep, const int length, const int spacing)
+{
+    int previous = -1;
+    for(int i = 0; i < length; ++i) {
+        const StrokeValue value = drawn[i * drawnStep];
+        if(value == Constants::strokeBackground)
+            continue;
+        if(previous >= 0 && i - previous > 1 && i - previous - 1 <= spacing) {
+            const StrokeValue fill = std::min(value, drawn[previous * drawnStep]);
+            for(int j = previous + 1; j < i; ++j) {
+                strokes[j * strokesStep] = std::min(strokes[j * strokesStep], fill);
+            }
+        }
+        previous = i;
+    }
+}
+
+/*
+    Rays of subsampled edge pixels are a few pixels apart along their
+    edge, the background left between them inside a stroke is at most
+    the sampling spacing wide. Only background with drawn strokes on both sides of a row or
+    column within that spacing is filled, drawn stroke values stay as they
+    are. Background gaps that narrow between letters get filled as well.
+*/
+void Ray::fillGaps(const float rayDensity)
+{
+    const int spacing = samplingSpacing(samplingThreshold(rayDensity));
+    const cv::Mat_<StrokeValue> drawn = Pictures::strokes.clone();
+    const int drawnStep = drawn.step / sizeof(StrokeValue);
+    const int strokesStep = Pictures::strokes.step / sizeof(StrokeValue);
+    for(int y = 0; y < drawn.rows; ++y) {
+        fillRun(drawn[y], 1, Pictures::strokes[y], 1, drawn.cols, spacing);
+    }
+    for(int x = 0; x < drawn.cols; ++x) {
+        fillRun(drawn[0] + x, drawnStep, Pictures::strokes[0] + x, strokesStep, drawn.rows, spacing);
+    }
+}
+
+double Ray::allocatedBytes(const std::list<Ray*>& rays)
+{
+    double bytes = 0;
+    for(std::list<Ray*>::const_iterator i = rays.begin(); i != rays.end(); ++i) {
+        bytes += sizeof(Ray) + 3 * sizeof(void*) + (*i)->steps.capacity() * sizeof(cv::Point);
+    }
+    return bytes;
+}
+
+void Ray::release(const std::list<Ray*>& rays)
+{
+    for(std::list<Ray*>::const_iterator i = rays.begin(); i != rays.end(); ++i) {
+        delete *i;
+    }
 }
@@ -1,6 +1,10 @@
+#ifndef OCTOSHARK_RAY_HPP
+#define OCTOSHARK_RAY_HPP
+
 #include <list>
 #include <opencv/cv.h>
 #include "contour.hpp"
+#include "config.hpp"
 
 inline float computeAngle(const float dx, const float dy)
 {    
@@ -26,7 +30,26 @@ public:
     static bool isAt(const int x,const int y);
 };
 
+/*
+    Edge pixel with everything ray casting needs from it, collected once
+    in row order so the casting loop touches no other picture.
+*/
+struct EdgePixel {
+    int x;
+    int y;
+    short sobelX;
+    short sobelY;
+    const Contour* contour;
+    static std::vector<EdgePixel> collect(const std::vector<std::vector<Contour*> >& contourLimitMap);
+    static void dropTextureTiles(std::vector<EdgePixel>& edges, const Config::Parameters& parameters);
+};
+
 class Ray {
+    friend class RayCasting;
+public:
+    // rays into light strokes follow the gradient, into dark ones they go against it
+    enum Directions { alongGradient = 1, againstGradient = 2, bothDirections = 3 };
+private:
     //static tbb::concurrent_deque<Ray*> knownRays;
     const PointOfInterest start;
     const int sobelX;
@@ -41,25 +64,28 @@ class Ray {
     void takeStepX(const float);
     void takeStepY(const float);
     float computeSlope(const float) const;
-    bool furtherStepsArePossible() const;
+    bool furtherStepsArePossible(const int maximumStrokeWidthSquared) const;
     bool hitEdge() const;
     int currentPosX() const;
     int currentPosY() const;
     bool goalReached(const float goal, const int step) const;
-    bool betweenParallelEdges() const;
+    bool betweenParallelEdges(const int maximumStrokeAngle) const;
     void drawPoint(const int x, const int y) const;
     void printSteps();
-    static int maximumStrokeAngle;
-    static int maximumStrokeWidth;
-    static int maximumStrokeWidthSquared;
+    static bool startsBefore(const Ray* const a, const Ray* const b);
 public:    
     const float slopeX;
     const float slopeY;
-    Ray* build();
+    Ray* build(const Config::Parameters& parameters);
     void draw() const;
     void redraw();
-    static std::list<Ray*> buildRays(const std::vector<std::vector<Contour*> >&);
+    static std::list<Ray*> buildRays(const std::vector<EdgePixel>&, const Config::Parameters&, const int directions);
+    static int estimatePolarity(const std::vector<EdgePixel>&, const Config::Parameters&);
+    static int estimateMaxStrokeWidth(const std::vector<EdgePixel>&, const Config::Parameters&);
     static void drawRays(std::list<Ray*>&);
+    static void fillGaps(const float rayDensity);
+    static void release(const std::list<Ray*>&);
+    static double allocatedBytes(const std::list<Ray*>&);
     Ray(const PointOfInterest& start,
         const int sobelX,
         const int sobelY,
@@ -67,3 +93,5 @@ public:
         const Contour* const contour
     );
 };
+
+#endif
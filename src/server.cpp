@@ -0,0 +1,236 @@
+#include "server.hpp"
+#include "config.hpp"
+#include "pictures.hpp"
+#include "detection.hpp"
+#include "candidate.hpp"
+#include "queue.hpp"
+#include "profiler.hpp"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <opencv/highgui.h>
+
+namespace Server {
+    struct Request {
+        char kind;
+        std::vector<uchar> payload;
+        double received;
+        std::promise<std::string> reply;
+    };
+
+    // bounds the number of requests that are queued or being detected
+    class InFlightLimit {
+        int available;
+        std::mutex mutex;
+        std::condition_variable released;
+    public:
+        InFlightLimit(const int maximum) : available(maximum > 0 ? maximum : 1) {};
+        void acquire();
+        void release();
+    };
+
+    std::string detect(Request& request);
+    void work(BoundedQueue<Request*>* requests);
+    void serve(const int connection, BoundedQueue<Request*>* requests, InFlightLimit* limit);
+    bool readFully(const int connection, void* buffer, size_t length);
+    bool writeFully(const int connection, const void* buffer, size_t length);
+    std::string errorReply(const std::string& message);
+}
+
+void Server::InFlightLimit::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(available == 0)
+        released.wait(lock);
+    --available;
+}
+
+void Server::InFlightLimit::release()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ++available;
+    released.notify_one();
+}
+
+bool Server::readFully(const int connection, void* buffer, size_t length)
+{
+    char* position = static_cast<char*>(buffer);
+    while(length > 0) {
+        const ssize_t received = read(connection, position, length);
+        if(received <= 0)
+            return false;
+        position += received;
+        length -= received;
+    }
+    return true;
+}
+
+bool Server::writeFully(const int connection, const void* buffer, size_t length)
+{
+    const char* position = static_cast<const char*>(buffer);
+    while(length > 0) {
+        const ssize_t written = write(connection, position, length);
+        if(written <= 0)
+            return false;
+        position += written;
+        length -= written;
+    }
+    return true;
+}
+
+/*
+    Messages may come from exceptions of other libraries, quotes and
+    backslashes are escaped and control characters become spaces.
+*/
+std::string Server::errorReply(const std::string& message)
+{
+    std::string reply("{\"status\":\"error\",\"message\":\"");
+    for(std::string::const_iterator i = message.begin(); i != message.end(); ++i) {
+        if(*i == '"' || *i == '\\')
+            reply.push_back('\\');
+        reply.push_back((unsigned char) *i < 0x20 ? ' ' : *i);
+    }
+    return reply.append("\"}");
+}
+
+std::string Server::detect(Request& request)
+{
+    const double dequeued = Profiler::now();
+    Profiler::startImage(request.kind == 'p' ? std::string(request.payload.begin(), request.payload.end()) : std::string("<bytes>"));
+    {
+        Profiler::Span span("init");
+        cv::Mat original, input;
+        if(request.kind != 'p' && request.kind != 'i')
+            return Server::errorReply("Unknown request kind.");
+        try {
+            if(request.kind == 'p')
+                Pictures::decode(std::string(request.payload.begin(), request.payload.end()), original, input);
+            else
+                Pictures::decode(request.payload, original, input);
+        } catch (const char* e) {
+            return Server::errorReply("Could not read image.");
+        }
+        Pictures::initialize(original, input);
+    }
+    Detection detection(Config::parameters);
+    detection.run();
+    const double detected = Profiler::now();
+    Profiler::count("queueSeconds", dequeued - request.received);
+
+    const Profiler::Image& image = Profiler::currentImage();
+    std::stringstream reply;
+    reply<<"{\"status\":\"ok\",\"boxes\":[";
+    for(std::vector<LineCandidate*>::const_iterator i = detection.lineCandidates.begin(); i != detection.lineCandidates.end(); ++i) {
+        const cv::Rect box = (*i)->getBoundingRect();
+        reply<<(i == detection.lineCandidates.begin() ? "" : ",")<<'['<<box.x<<','<<box.y<<','<<box.width<<','<<box.height<<']';
+    }
+    reply<<"],\"seconds\":{\"queue\":"<<dequeued - request.received;
+    for(std::vector<Profiler::Event>::const_iterator i = image.events.begin(); i != image.events.end(); ++i) {
+        reply<<",\""<<i->name<<"\":"<<i->seconds;
+    }
+    reply<<",\"total\":"<<detected - request.received<<"}}";
+    Profiler::finishImage();
+    return reply.str();
+}
+
+void Server::work(BoundedQueue<Request*>* requests)
+{
+    Request* request;
+    while(requests->pop(request)) {
+        try {
+            request->reply.set_value(Server::detect(*request));
+        } catch (const char* e) {
+            request->reply.set_value(Server::errorReply(e));
+        } catch (const std::exception& e) {
+            request->reply.set_value(Server::errorReply(e.what()));
+        } catch (...) {
+            request->reply.set_value(Server::errorReply("Detection failed."));
+        }
+    }
+}
+
+void Server::serve(const int connection, BoundedQueue<Request*>* requests, InFlightLimit* limit)
+{
+    const uint32_t maximumRequestSize = Config::parameters.serverMaxRequestSize;
+    while(true) {
+        uint32_t length;
+        Request request;
+        if(!Server::readFully(connection, &length, sizeof(length)) || !Server::readFully(connection, &request.kind, 1))
+            break;
+        length = ntohl(length);
+        if(maximumRequestSize > 0 && length > maximumRequestSize) {
+            const std::string reply = Server::errorReply("Request too large.");
+            const uint32_t replyLength = htonl(reply.size());
+            Server::writeFully(connection, &replyLength, sizeof(replyLength));
+            Server::writeFully(connection, reply.data(), reply.size());
+            break;
+        }
+        request.payload.resize(length);
+        if(length > 0 && !Server::readFully(connection, &request.payload[0], length))
+            break;
+        // waiting for a free slot stops reading from the socket, which pushes back on the client
+        limit->acquire();
+        request.received = Profiler::now();
+        std::future<std::string> futureReply = request.reply.get_future();
+        requests->push(&request);
+        const std::string reply = futureReply.get();
+        limit->release();
+        const uint32_t replyLength = htonl(reply.size());
+        if(!Server::writeFully(connection, &replyLength, sizeof(replyLength)) || !Server::writeFully(connection, reply.data(), reply.size()))
+            break;
+    }
+    close(connection);
+}
+
+void Server::run(const std::string& socketFileName)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(socketFileName.size() >= sizeof(address.sun_path))
+        throw "Socket filename is too long.";
+    std::strncpy(address.sun_path, socketFileName.c_str(), sizeof(address.sun_path) - 1);
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0)
+        throw "Could not create socket.";
+    unlink(socketFileName.c_str());
+    if(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+        throw "Could not listen on socket.";
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const int maximumInFlight = Config::parameters.serverMaxInFlight;
+    int threadCount = Config::parameters.serverThreads;
+    if(threadCount <= 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    InFlightLimit limit(maximumInFlight);
+    BoundedQueue<Request*> requests(maximumInFlight);
+    std::vector<std::thread> workers;
+    for(int i = 0; i < threadCount; ++i) {
+        workers.push_back(std::thread(Server::work, &requests));
+    }
+    std::cout<<"Listening on "<<socketFileName<<" with "<<threadCount<<" detection threads."<<std::endl;
+    while(true) {
+        const int connection = accept(listener, NULL, NULL);
+        if(connection < 0) {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        std::thread(Server::serve, connection, &requests, &limit).detach();
+    }
+    requests.close();
+    for(std::vector<std::thread>::iterator i = workers.begin(); i != workers.end(); ++i) {
+        i->join();
+    }
+    close(listener);
+    unlink(socketFileName.c_str());
+}
@@ -0,0 +1,20 @@
+#ifndef OCTOSHARK_SERVER_HPP
+#define OCTOSHARK_SERVER_HPP
+
+#include <string>
+
+/*
+    Detection daemon listening on a unix domain socket.
+
+    A request is a 4 byte payload length in network byte order, a kind byte
+    ('p' for a path to an image file, 'i' for encoded image bytes) and the
+    payload. Each request is answered with a 4 byte length in network byte
+    order followed by a JSON object carrying the line boxes as [x,y,w,h]
+    and the seconds spent in every stage. Requests of one connection are
+    answered in order; several connections are served concurrently.
+*/
+namespace Server {
+    void run(const std::string& socketFileName);
+}
+
+#endif
@@ -0,0 +1,653 @@
+#include "../bench/generator.hpp"
+#include "../config.hpp"
+#include "../pictures.hpp"
+#include "../ray.hpp"
+#include "../component.hpp"
+#include "../candidate.hpp"
+#include "../detection.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+
+/*
+    Differential tests of the optimized kernels against the code they
+    replace or that the pipeline uses by default, the reference. Inputs are
+    randomized synthetic pages and stroke maps, plus image fixtures given
+    on the command line. The first divergence of a kernel is reported with
+    the pixel or line where it happened, along with the seed to repeat it.
+
+    Usage: differential [--seed n] [--rounds n] [image...]
+
+    A new kernel gets a comparison next to the one of its reference.
+    make tests also runs a build with -D TILED_PICTURES, where ray
+    casting goes tile by tile and the tiled pictures are compared to
+    the row-major ones.
+*/
+
+namespace Constants {
+    const int defaultRounds = 12;
+    // as in ray.cpp
+    const int textureOrientationBins = 16;
+    const int textureMinimumEdges = 32;
+    const int strokeWidthSampleSize = 1024;
+    const int minimumStrokeWidthSamples = 64;
+    const int minimumAutoStrokeWidth = 8;
+}
+
+int failures = 0;
+
+std::string describe(const cv::Rect& rect)
+{
+    std::stringstream description;
+    description<<rect.x<<','<<rect.y<<','<<rect.width<<','<<rect.height;
+    return description.str();
+}
+
+void report(const std::string& kernel, const std::string& input, const std::string& divergence)
+{
+    std::cout<<kernel<<" diverges on "<<input<<": "<<divergence<<std::endl;
+    ++failures;
+}
+
+/*
+    Returns false and describes the first pixel in row order that differs.
+*/
+template<typename T>
+bool compareMaps(const cv::Mat_<T>& reference, const cv::Mat_<T>& alternative, std::string& divergence)
+{
+    for(int y = 0; y < reference.rows; ++y) {
+        for(int x = 0; x < reference.cols; ++x) {
+            if(reference(y, x) != alternative(y, x)) {
+                std::stringstream description;
+                description<<"pixel ("<<x<<", "<<y<<") is "<<(int) alternative(y, x)<<" instead of "<<(int) reference(y, x);
+                divergence = description.str();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+    Every stroke pixel labeled with the first pixel in row order of its
+    equivalence class, -1 for background, so labelings compare pixelwise
+    regardless of how components were allocated.
+*/
+cv::Mat_<int> classLabels(const std::list<Component*>& components, const cv::Size& size)
+{
+    cv::Mat_<int> labels(size, -1);
+    std::map<const std::vector<Component*>*, int> first;
+    for(std::list<Component*>::const_iterator i = components.begin(); i != components.end(); ++i) {
+        for(std::list<cv::Point>::const_iterator p = (*i)->coordinates.begin(); p != (*i)->coordinates.end(); ++p) {
+            const int index = p->y * size.width + p->x;
+            std::map<const std::vector<Component*>*, int>::iterator known = first.find((*i)->getEquivalenceClass());
+            if(known == first.end())
+                first[(*i)->getEquivalenceClass()] = index;
+            else if(index < known->second)
+                known->second = index;
+        }
+    }
+    for(std::list<Component*>::const_iterator i = components.begin(); i != components.end(); ++i) {
+        for(std::list<cv::Point>::const_iterator p = (*i)->coordinates.begin(); p != (*i)->coordinates.end(); ++p) {
+            labels(p->y, p->x) = first[(*i)->getEquivalenceClass()];
+        }
+    }
+    return labels;
+}
+
+cv::Mat_<int> labelComponents(const Config::Parameters& parameters)
+{
+    const std::list<Component*> components = Component::findAll(parameters);
+    const std::set<const std::vector<Component*>*> equivalenceClasses = Component::collectEquivalenceClasses(components);
+    const cv::Mat_<int> labels = classLabels(components, Pictures::strokes.size());
+    Component::release(components, equivalenceClasses);
+    return labels;
+}
+
+/*
+    Labeling from stroke runs against labeling from similarity masks, and
+    the vectorized similarity masks against pairwise ratio tests.
+*/
+void testLabeling(const cv::Mat_<StrokeValue>& strokes, const std::string& input)
+{
+    Pictures::strokes = strokes;
+    Config::Parameters dense = Config::parameters;
+    dense.sparseStrokeShare = 0;
+    Config::Parameters sparse = Config::parameters;
+    sparse.sparseStrokeShare = 1;
+    const cv::Mat_<int> reference = labelComponents(dense);
+    std::string divergence;
+    if(!compareMaps(reference, labelComponents(sparse), divergence))
+        report("sparse labeling", input, divergence);
+
+    // findAll has set the grouping threshold
+    cv::Mat_<uchar> masks(strokes.size(), (uchar) 0);
+    for(int y = 0; y < strokes.rows; ++y) {
+        for(int x = 0; x < strokes.cols; ++x) {
+            const bool hasLeft = x > 0, hasTop = y > 0, hasRight = x + 1 < strokes.cols;
+            uchar& mask = masks(y, x);
+            if(hasLeft && Component::haveSimilarStrokeWidths(strokes(y, x), strokes(y, x - 1))) mask |= 1;
+            if(hasLeft && hasTop && Component::haveSimilarStrokeWidths(strokes(y, x), strokes(y - 1, x - 1))) mask |= 2;
+            if(hasTop && Component::haveSimilarStrokeWidths(strokes(y, x), strokes(y - 1, x))) mask |= 4;
+            if(hasRight && hasTop && Component::haveSimilarStrokeWidths(strokes(y, x), strokes(y - 1, x + 1))) mask |= 8;
+            if(hasLeft && hasRight && hasTop && Component::haveSimilarStrokeWidths(strokes(y - 1, x - 1), strokes(y - 1, x + 1))) mask |= 16;
+            if(hasLeft && hasRight && hasTop && Component::haveSimilarStrokeWidths(strokes(y, x - 1), strokes(y - 1, x + 1))) mask |= 32;
+        }
+    }
+    if(!compareMaps(masks, Component::computeSimilarities(strokes), divergence))
+        report("similarity masks", input, divergence);
+}
+
+/*
+    The batched ray casting of Ray::buildRays against building every ray
+    of every edge pixel one by one with Ray::build, in the same order, both
+    drawn into a fresh stroke map. Rays along the gradient start with its
+    sign, rays against it with the opposite one, directions says which
+    are cast. Returns the reference strokes.
+*/
+cv::Mat_<StrokeValue> testRays(const std::string& input, const int directions)
+{
+    Config::Parameters parameters = Config::parameters;
+    parameters.adaptiveShearing = false;
+    parameters.rayDensity = 1;
+    std::vector<Contour*> contours;
+    const std::vector<EdgePixel> edges = EdgePixel::collect(Contour::buildLimitMap(Pictures::canny, contours, parameters));
+
+    std::list<Ray*> rays;
+    for(std::vector<EdgePixel>::const_iterator edge = edges.begin(); edge != edges.end(); ++edge) {
+        for(std::vector<int>::const_iterator angle = parameters.shearingAngles.begin(); angle != parameters.shearingAngles.end(); ++angle) {
+            for(int sign = 1; sign >= -1; sign -= 2) {
+                if(!(directions & (sign > 0 ? Ray::alongGradient : Ray::againstGradient)))
+                    continue;
+                Ray* ray = new Ray(PointOfInterest(edge->x, edge->y), sign * edge->sobelX, sign * edge->sobelY, *angle, edge->contour);
+                if(ray->build(parameters) == NULL)
+                    delete ray;
+                else
+                    rays.push_back(ray);
+            }
+        }
+    }
+    Pictures::strokes = cv::Mat_<StrokeValue>(Pictures::canny.size(), Constants::strokeBackground);
+    Ray::drawRays(rays);
+    Ray::release(rays);
+    const cv::Mat_<StrokeValue> reference = Pictures::strokes;
+
+    Pictures::strokes = cv::Mat_<StrokeValue>(Pictures::canny.size(), Constants::strokeBackground);
+    rays = Ray::buildRays(edges, parameters, directions);
+    Ray::drawRays(rays);
+    Ray::release(rays);
+    std::string divergence;
+    if(!compareMaps(reference, Pictures::strokes, divergence))
+        report(directions == Ray::bothDirections ? "batched ray casting" : directions == Ray::alongGradient ? "batched ray casting along the gradient" : "batched ray casting against the gradient", input, divergence);
+
+    for(std::vector<Contour*>::const_iterator i = contours.begin(); i != contours.end(); ++i) {
+        delete *i;
+    }
+    return reference;
+}
+
+/*
+    Texture tiles found by scanning canny and orientations tile by tile
+    against EdgePixel::dropTextureTiles, which gathers the statistics of
+    all tiles in one pass over the edge pixels. The thresholds are lowered
+    so that synthetic pages have tiles on both sides of them.
+*/
+void testTextureTiles(const std::string& input)
+{
+    Config::Parameters parameters = Config::parameters;
+    parameters.textureTileSize = 16;
+    parameters.textureEdgeDensity = 0.05;
+    parameters.textureOrientationEntropy = 0.5;
+    parameters.textureSpacingVariation = 0.3;
+    std::vector<Contour*> contours;
+    std::vector<EdgePixel> edges = EdgePixel::collect(Contour::buildLimitMap(Pictures::canny, contours, parameters));
+
+    const int tileSize = parameters.textureTileSize;
+    const int tilesX = (Pictures::canny.cols + tileSize - 1) / tileSize;
+    const int tilesY = (Pictures::canny.rows + tileSize - 1) / tileSize;
+    std::vector<bool> texture(tilesX * tilesY, false);
+    for(int tileY = 0; tileY != tilesY; ++tileY) {
+        for(int tileX = 0; tileX != tilesX; ++tileX) {
+            const cv::Rect tile = cv::Rect(tileX * tileSize, tileY * tileSize, tileSize, tileSize) & cv::Rect(0, 0, Pictures::canny.cols, Pictures::canny.rows);
+            int tileEdges = 0, gaps = 0;
+            double gapSum = 0, gapSquareSum = 0;
+            int histogram[Constants::textureOrientationBins] = {0};
+            for(int y = tile.y; y != tile.y + tile.height; ++y) {
+                int previous = -1;
+                for(int x = tile.x; x != tile.x + tile.width; ++x) {
+                    if(Pictures::canny(y, x) == 0)
+                        continue;
+                    ++tileEdges;
+                    if(Pictures::orientations(y, x) != Constants::noOrientation)
+                        ++histogram[Pictures::orientations(y, x) * Constants::textureOrientationBins / Constants::orientationHalfTurn];
+                    if(previous >= 0) {
+                        ++gaps;
+                        gapSum += x - previous;
+                        gapSquareSum += (x - previous) * (x - previous);
+                    }
+                    previous = x;
+                }
+            }
+            if(tileEdges < Constants::textureMinimumEdges || gaps < 2 || tileEdges < parameters.textureEdgeDensity * tile.area())
+                continue;
+            double entropy = 0;
+            for(int i = 0; i != Constants::textureOrientationBins; ++i) {
+                if(histogram[i] != 0)
+                    entropy -= (double) histogram[i] / tileEdges * std::log((double) histogram[i] / tileEdges);
+            }
+            if(entropy < parameters.textureOrientationEntropy * std::log((double) Constants::textureOrientationBins))
+                continue;
+            const double meanGap = gapSum / gaps;
+            texture[tileY * tilesX + tileX] = std::sqrt(std::max(0.0, gapSquareSum / gaps - meanGap * meanGap)) >= parameters.textureSpacingVariation * meanGap;
+        }
+    }
+    std::vector<EdgePixel> reference;
+    for(std::vector<EdgePixel>::const_iterator edge = edges.begin(); edge != edges.end(); ++edge) {
+        if(!texture[(edge->y / tileSize) * tilesX + edge->x / tileSize])
+            reference.push_back(*edge);
+    }
+
+    EdgePixel::dropTextureTiles(edges, parameters);
+    for(size_t i = 0; i <= std::min(reference.size(), edges.size()); ++i) {
+        if(i == reference.size() && i == edges.size())
+            break;
+        if(i == reference.size() || i == edges.size() || reference[i].x != edges[i].x || reference[i].y != edges[i].y) {
+            const EdgePixel& first = i == reference.size() ? edges[i] : reference[i];
+            std::stringstream description;
+            description<<"edge pixel "<<i<<" at ("<<first.x<<','<<first.y<<") of "<<reference.size()<<" kept, "<<edges.size()<<" kept by the kernel";
+            report("texture tiles", input, description.str());
+            break;
+        }
+    }
+    for(std::vector<Contour*>::const_iterator i = contours.begin(); i != contours.end(); ++i) {
+        delete *i;
+    }
+}
+
+/*
+    The stroke width cap from a histogram of sampled rays against the
+    percentile of the sorted stroke widths of all rays, on at most
+    strokeWidthSampleSize edge pixels so the kernel samples every one.
+    A ray's stroke width is what it draws at its start pixel.
+*/
+void testMaxStrokeWidth(const std::string& input)
+{
+    Config::Parameters parameters = Config::parameters;
+    parameters.autoStrokeWidthPercentile = 0.9;
+    std::vector<Contour*> contours;
+    std::vector<EdgePixel> edges = EdgePixel::collect(Contour::buildLimitMap(Pictures::canny, contours, parameters));
+    edges.resize(std::min(edges.size(), (size_t) Constants::strokeWidthSampleSize));
+
+    int shearingAngle = parameters.shearingAngles.front();
+    for(std::vector<int>::const_iterator angle = parameters.shearingAngles.begin(); angle != parameters.shearingAngles.end(); ++angle) {
+        if(abs(*angle) < abs(shearingAngle))
+            shearingAngle = *angle;
+    }
+    Pictures::strokes = cv::Mat_<StrokeValue>(Pictures::canny.size(), Constants::strokeBackground);
+#ifdef TILED_PICTURES
+    Pictures::tiledStrokes.assign(Pictures::strokes);
+    TiledPicture<StrokeValue>& strokes = Pictures::tiledStrokes;
+#else
+    cv::Mat_<StrokeValue>& strokes = Pictures::strokes;
+#endif
+    std::vector<int> strokeWidths;
+    for(std::vector<EdgePixel>::const_iterator edge = edges.begin(); edge != edges.end(); ++edge) {
+        for(int sign = 1; sign >= -1; sign -= 2) {
+            Ray ray(PointOfInterest(edge->x, edge->y), sign * edge->sobelX, sign * edge->sobelY, shearingAngle, edge->contour);
+            if(ray.build(parameters) == NULL)
+                continue;
+            strokes(edge->y, edge->x) = Constants::strokeBackground;
+            ray.draw();
+            strokeWidths.push_back(std::min((int) strokes(edge->y, edge->x), parameters.maxStrokeWidth));
+        }
+    }
+#ifdef TILED_PICTURES
+    Pictures::tiledStrokes.release();
+#endif
+    int reference = parameters.maxStrokeWidth;
+    if((int) strokeWidths.size() >= Constants::minimumStrokeWidthSamples) {
+        std::sort(strokeWidths.begin(), strokeWidths.end());
+        const int rank = (int) std::ceil(parameters.autoStrokeWidthPercentile * strokeWidths.size());
+        reference = (int) std::ceil(strokeWidths[rank - 1] * parameters.autoStrokeWidthFactor) + 1;
+        reference = std::min(parameters.maxStrokeWidth, std::max(Constants::minimumAutoStrokeWidth, reference));
+    }
+    const int maximumStrokeWidth = Ray::estimateMaxStrokeWidth(edges, parameters);
+    if(maximumStrokeWidth != reference) {
+        std::stringstream description;
+        description<<maximumStrokeWidth<<" instead of "<<reference<<" from "<<strokeWidths.size()<<" rays";
+        report("stroke width estimate", input, description.str());
+    }
+    for(std::vector<Contour*>::const_iterator i = contours.begin(); i != contours.end(); ++i) {
+        delete *i;
+    }
+}
+
+/*
+    Lines of identical letters, evenly spaced within reach of their
+    neighbours but not of the letters after them, horizontal or vertical
+    and far from each other. Every engine has to find exactly these lines,
+    the unions of their letters.
+*/
+std::vector<LetterCandidate*> collinearLetterCandidates(cv::RNG& rng, const bool vertical, const Config::Parameters& parameters, std::vector<std::string>& expectedLines)
+{
+    std::vector<LetterCandidate*> letterCandidates;
+    const float reach = std::min(parameters.maxLetterDistXByStrokeWidth, parameters.maxLetterDistYByStrokeWidth);
+    const float farReach = std::max(parameters.maxLetterDistXByStrokeWidth, parameters.maxLetterDistYByStrokeWidth);
+    const int lines = rng.uniform(1, 8);
+    for(int line = 0; line != lines; ++line) {
+        const int height = rng.uniform(16, 40);
+        const float strokeWidth = height / 8.0f;
+        const int gap = std::max(1, (int) (strokeWidth * reach / 2));
+        const int extent = std::max(height / 2, (int) (strokeWidth * farReach) + 1);
+        const cv::Vec3i color(rng.uniform(0, 255), rng.uniform(0, 255), rng.uniform(0, 255));
+        const int letters = std::max((int) parameters.minLineSize, 3) + rng.uniform(0, 10);
+        int along = rng.uniform(0, 200);
+        const int across = 2000 * line + rng.uniform(0, 100);
+        cv::Rect lineRect;
+        for(int letter = 0; letter != letters; ++letter) {
+            const cv::Rect box = vertical ? cv::Rect(across, along, height, extent) : cv::Rect(along, across, extent, height);
+            letterCandidates.push_back(new LetterCandidate(strokeWidth, color, box.area() / 3, box));
+            lineRect = letter == 0 ? box : lineRect | box;
+            along += extent + gap;
+        }
+        expectedLines.push_back(describe(lineRect));
+    }
+    std::sort(expectedLines.begin(), expectedLines.end());
+    return letterCandidates;
+}
+
+/*
+    The sweep engines of every sector and the proximity graph against
+    the known lines of collinear letters, each on its own copies.
+    Frustum and cone only look along x and skip vertical lines.
+*/
+void testGrouping(cv::RNG& rng, const std::string& input)
+{
+    const Config::LineSector sectors[] = {Config::xySector, Config::frustumSector, Config::coneSector, Config::graphSector};
+    const char* const sectorNames[] = {"xy", "frustum", "cone", "graph"};
+    for(int vertical = 0; vertical != 2; ++vertical) {
+        std::vector<std::string> expectedLines;
+        const std::vector<LetterCandidate*> letterCandidates = collinearLetterCandidates(rng, vertical != 0, Config::parameters, expectedLines);
+        for(int i = 0; i != 4; ++i) {
+            if(vertical && (sectors[i] == Config::frustumSector || sectors[i] == Config::coneSector))
+                continue;
+            Config::Parameters parameters = Config::parameters;
+            parameters.lineSector = sectors[i];
+            std::vector<LetterCandidate*> copies = LetterCandidate::copy(letterCandidates);
+            const std::vector<LineCandidate*> lines = LetterCandidate::identifyLineCandidates(copies, parameters);
+            std::vector<std::string> foundLines;
+            for(std::vector<LineCandidate*>::const_iterator line = lines.begin(); line != lines.end(); ++line) {
+                foundLines.push_back(describe((*line)->getBoundingRect()));
+            }
+            std::sort(foundLines.begin(), foundLines.end());
+            if(foundLines != expectedLines) {
+                std::stringstream description;
+                description<<foundLines.size()<<" lines instead of "<<expectedLines.size();
+                for(size_t line = 0; line != expectedLines.size(); ++line) {
+                    if(std::find(foundLines.begin(), foundLines.end(), expectedLines[line]) == foundLines.end()) {
+                        description<<", "<<expectedLines[line]<<" is missing";
+                        break;
+                    }
+                }
+                report(std::string("grouping with the ") + sectorNames[i] + " sector", input + (vertical ? " (vertical letters)" : " (horizontal letters)"), description.str());
+            }
+            LetterCandidate::release(copies, lines);
+        }
+        LetterCandidate::release(letterCandidates, std::vector<LineCandidate*>());
+    }
+}
+
+/*
+    The Delaunay pairs of the proximity graph against a brute force
+    search: each candidate has to be paired with one of its nearest
+    neighbours.
+*/
+void testProximityGraph(const std::vector<LetterCandidate*>& letterCandidates, const std::string& input)
+{
+    const std::vector<std::pair<LetterCandidate*, LetterCandidate*> > pairs = LetterCandidate::proximityPairs(letterCandidates);
+    std::map<const LetterCandidate*, std::set<const LetterCandidate*> > neighbours;
+    for(std::vector<std::pair<LetterCandidate*, LetterCandidate*> >::const_iterator i = pairs.begin(); i != pairs.end(); ++i) {
+        neighbours[i->first].insert(i->second);
+        neighbours[i->second].insert(i->first);
+    }
+    for(std::vector<LetterCandidate*>::const_iterator i = letterCandidates.begin(); i != letterCandidates.end(); ++i) {
+        long long nearest = -1;
+        for(std::vector<LetterCandidate*>::const_iterator j = letterCandidates.begin(); j != letterCandidates.end(); ++j) {
+            const cv::Point distance = (*i)->center - (*j)->center;
+            const long long squared = (long long) distance.x * distance.x + (long long) distance.y * distance.y;
+            if(i != j && (nearest < 0 || squared < nearest))
+                nearest = squared;
+        }
+        if(nearest < 0)
+            continue;
+        bool paired = false;
+        const std::set<const LetterCandidate*>& candidates = neighbours[*i];
+        for(std::set<const LetterCandidate*>::const_iterator j = candidates.begin(); j != candidates.end() && !paired; ++j) {
+            const cv::Point distance = (*i)->center - (*j)->center;
+            paired = (long long) distance.x * distance.x + (long long) distance.y * distance.y == nearest;
+        }
+        if(!paired) {
+            std::stringstream description;
+            description<<"letter at "<<(*i)->center.x<<','<<(*i)->center.y<<" lacks its nearest neighbour";
+            report("proximity graph", input, description.str());
+            return;
+        }
+    }
+}
+
+/*
+    Rectangles and lines of random widths on background, some touching.
+*/
+cv::Mat_<StrokeValue> randomStrokes(cv::RNG& rng)
+{
+    cv::Mat_<StrokeValue> strokes(cv::Size(rng.uniform(1, 200), rng.uniform(1, 120)), Constants::strokeBackground);
+    const int shapes = rng.uniform(0, 40);
+    const int maximumWidth = rng.uniform(2, std::min(64, (int) Constants::strokeBackground));
+    for(int i = 0; i != shapes; ++i) {
+        const cv::Point from(rng.uniform(0, strokes.cols), rng.uniform(0, strokes.rows));
+        const cv::Point to(rng.uniform(0, strokes.cols), rng.uniform(0, strokes.rows));
+        const cv::Scalar width(rng.uniform(1, maximumWidth));
+        if(rng.uniform(0, 2) == 0)
+            cv::rectangle(strokes, from, to, width, -1);
+        else
+            cv::line(strokes, from, to, width, rng.uniform(1, 6));
+    }
+    return strokes;
+}
+
+/*
+    Lines of letters with similar measurements and scattered noise
+    candidates with random ones.
+*/
+std::vector<LetterCandidate*> randomLetterCandidates(cv::RNG& rng)
+{
+    std::vector<LetterCandidate*> letterCandidates;
+    const int lines = rng.uniform(0, 12);
+    for(int line = 0; line != lines; ++line) {
+        const int height = rng.uniform(10, 60);
+        const float strokeWidth = rng.uniform(1.0f, height / 4.0f);
+        const cv::Vec3i color(rng.uniform(0, 255), rng.uniform(0, 255), rng.uniform(0, 255));
+        int x = rng.uniform(0, 500);
+        const int y = rng.uniform(0, 1500);
+        const int letters = rng.uniform(1, 20);
+        for(int letter = 0; letter != letters; ++letter) {
+            const int width = rng.uniform(height / 3, height);
+            const cv::Rect box(x, y + rng.uniform(-height / 8, height / 8 + 1), width, height + rng.uniform(-height / 8, height / 8 + 1));
+            letterCandidates.push_back(new LetterCandidate(strokeWidth * rng.uniform(0.8f, 1.25f), color, box.area() / 3, box));
+            x += width + rng.uniform(1, height / 2 + 2);
+        }
+    }
+    const int noise = rng.uniform(0, 30);
+    for(int i = 0; i != noise; ++i) {
+        const cv::Rect box(rng.uniform(0, 1500), rng.uniform(0, 1500), rng.uniform(2, 80), rng.uniform(2, 80));
+        const cv::Vec3i color(rng.uniform(0, 255), rng.uniform(0, 255), rng.uniform(0, 255));
+        letterCandidates.push_back(new LetterCandidate(rng.uniform(1.0f, 20.0f), color, box.area() / 3, box));
+    }
+    return letterCandidates;
+}
+
+cv::Mat_<StrokeValue> castRays(const cv::Mat& original, const cv::Mat& input, const Config::Parameters& parameters)
+{
+    Pictures::initialize(original, input);
+    Detection detection(parameters);
+    detection.castRays();
+    const cv::Mat_<StrokeValue> strokes = Pictures::strokes;
+    Pictures::release();
+    return strokes;
+}
+
+/*
+    Reduced ray densities with their gaps filled against the full density
+    on axis aligned bars starting on odd rows and columns. Sampling has to
+    keep rays on every edge wherever it lies, so every bar keeps most of
+    its stroke pixels.
+*/
+void testSampling(const SyntheticBars& bars)
+{
+    std::vector<cv::Rect> barRects;
+    const cv::Mat page = bars.render(&barRects);
+    cv::Mat grayPage;
+    cv::cvtColor(page, grayPage, CV_BGR2GRAY);
+    Config::Parameters fullParameters = Config::parameters;
+    fullParameters.rayDensity = 1;
+    fullParameters.textPolarity = Config::darkText;
+    fullParameters.textureTileSize = 0;
+    fullParameters.autoStrokeWidthPercentile = 0;
+    const cv::Mat_<StrokeValue> full = castRays(page, grayPage, fullParameters);
+    const float densities[] = {0.5f, 0.25f, 0.125f, 0.0625f};
+    for(int i = 0; i != 4; ++i) {
+        Config::Parameters parameters = fullParameters;
+        parameters.rayDensity = densities[i];
+        const cv::Mat_<StrokeValue> reduced = castRays(page, grayPage, parameters);
+        for(std::vector<cv::Rect>::const_iterator bar = barRects.begin(); bar != barRects.end(); ++bar) {
+            const cv::Rect area = cv::Rect(bar->x - 2, bar->y - 2, bar->width + 4, bar->height + 4) & cv::Rect(0, 0, full.cols, full.rows);
+            int strokePixels = 0, keptPixels = 0;
+            for(int y = area.y; y != area.y + area.height; ++y) {
+                for(int x = area.x; x != area.x + area.width; ++x) {
+                    if(full(y, x) == Constants::strokeBackground)
+                        continue;
+                    ++strokePixels;
+                    if(reduced(y, x) != Constants::strokeBackground)
+                        ++keptPixels;
+                }
+            }
+            if(2 * keptPixels < strokePixels) {
+                std::stringstream kernel, description;
+                kernel<<"sampling at rayDensity "<<densities[i];
+                description<<"bar "<<describe(*bar)<<" keeps "<<keptPixels<<" of "<<strokePixels<<" stroke pixels";
+                report(kernel.str(), bars.describe(), description.str());
+                break;
+            }
+        }
+    }
+}
+
+#ifdef TILED_PICTURES
+template<typename T>
+cv::Mat_<T> untile(const TiledPicture<T>& tiled, const cv::Size& size)
+{
+    cv::Mat_<T> picture(size);
+    tiled.copyTo(picture);
+    return picture;
+}
+
+/*
+    The tiled pictures ray marching reads against the row-major pictures
+    they were tiled from, and stroke maps through the tiled layout and
+    back as drawRays passes them.
+*/
+void testTiledPictures(const cv::Mat_<StrokeValue>& strokes, const std::string& input)
+{
+    std::string divergence;
+    if(!compareMaps(Pictures::canny, untile(Pictures::tiledCanny, Pictures::canny.size()), divergence))
+        report("tiled canny", input, divergence);
+    if(!compareMaps(Pictures::orientations, untile(Pictures::tiledOrientations, Pictures::orientations.size()), divergence))
+        report("tiled orientations", input, divergence);
+    TiledPicture<StrokeValue> tiledStrokes;
+    tiledStrokes.assign(strokes);
+    if(!compareMaps(strokes, untile(tiledStrokes, strokes.size()), divergence))
+        report("tiled strokes", input, divergence);
+}
+#endif
+
+void testImage(const cv::Mat& original, const cv::Mat& input, const std::string& name)
+{
+    Pictures::initialize(original, input);
+    const cv::Mat_<StrokeValue> strokes = testRays(name, Ray::bothDirections);
+#ifdef TILED_PICTURES
+    testTiledPictures(strokes, name);
+#endif
+    testRays(name, Ray::alongGradient);
+    testRays(name, Ray::againstGradient);
+    testTextureTiles(name);
+    testMaxStrokeWidth(name);
+    testLabeling(strokes, name);
+    Pictures::release();
+}
+
+int main(const int argc, const char** argv)
+{
+    unsigned int seed = 2010;
+    int rounds = Constants::defaultRounds;
+    std::vector<std::string> fixtures;
+    for(int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if(argument == "--seed" && i + 1 < argc)
+            seed = std::atoi(argv[++i]);
+        else if(argument == "--rounds" && i + 1 < argc)
+            rounds = std::atoi(argv[++i]);
+        else
+            fixtures.push_back(argument);
+    }
+    try {
+        Config::readConfigFile();
+    } catch (const char* e) {
+        std::cerr<<e<<std::endl<<"Aborting…\n";
+        return -1;
+    }
+    cv::RNG rng(seed);
+    for(int round = 0; round != rounds; ++round) {
+        std::stringstream name;
+        name<<"seed "<<seed<<" round "<<round;
+        SyntheticText text;
+        text.megapixels = rng.uniform(0.02, 0.15);
+        text.fontScale = rng.uniform(0.4, 2.0);
+        text.strokeWidth = rng.uniform(1, 5);
+        text.rotation = rng.uniform(-30.0, 30.0);
+        text.noise = rng.uniform(0.0, 30.0);
+        text.seed = rng.uniform(0, 1 << 30);
+        const cv::Mat page = text.render();
+        cv::Mat grayPage;
+        cv::cvtColor(page, grayPage, CV_BGR2GRAY);
+        testImage(page, grayPage, name.str() + " (" + text.describe() + ")");
+        testLabeling(randomStrokes(rng), name.str() + " (random strokes)");
+        const std::vector<LetterCandidate*> letterCandidates = randomLetterCandidates(rng);
+        testProximityGraph(letterCandidates, name.str() + " (random letters)");
+        LetterCandidate::release(letterCandidates, std::vector<LineCandidate*>());
+        testGrouping(rng, name.str());
+        SyntheticBars bars;
+        bars.strokeWidth = rng.uniform(2, 7);
+        testSampling(bars);
+    }
+    for(std::vector<std::string>::const_iterator fixture = fixtures.begin(); fixture != fixtures.end(); ++fixture) {
+        cv::Mat original, input;
+        try {
+            Pictures::decode(*fixture, original, input);
+        } catch (const char* e) {
+            std::cerr<<*fixture<<": "<<e<<std::endl;
+            ++failures;
+            continue;
+        }
+        testImage(original, input, *fixture);
+    }
+    if(failures != 0) {
+        std::cout<<failures<<" divergences."<<std::endl;
+        return 1;
+    }
+    std::cout<<"Everything fine!"<<std::endl;
+    return 0;
+}